@@ -0,0 +1,86 @@
+#include "render.hpp"
+
+VertexAnimation::VertexAnimation(const size_t numberOfVertices) {
+    this->numberOfVertices = numberOfVertices;
+}
+
+/*
+ * Appends the frames of a clip, every frame has to hold all vertices of the mesh in their order.
+ * Returns the clip index instances refer to, -1 if the clip was rejected
+ */
+int VertexAnimation::addClip(const std::vector<std::vector<Vertex>> & frames, const float framesPerSecond) {
+    if (frames.empty() || framesPerSecond <= 0.0f) return -1;
+
+    if (this->clips.size() >= static_cast<size_t>(VertexAnimation::MAX_CLIPS)) {
+        std::cerr << "Vertex animation has no room for more than " << VertexAnimation::MAX_CLIPS << " clips" << std::endl;
+        return -1;
+    }
+
+    for (auto & frame : frames) {
+        if (frame.size() != this->numberOfVertices) {
+            std::cerr << "Vertex animation frame has " << frame.size() << " vertices instead of " << this->numberOfVertices << std::endl;
+            return -1;
+        }
+    }
+
+    this->clips.push_back(glm::vec3(this->numberOfFrames, frames.size(), framesPerSecond));
+    this->numberOfFrames += frames.size();
+
+    this->texels.reserve(this->texels.size() + frames.size() * this->numberOfVertices * 2);
+    for (auto & frame : frames) {
+        for (auto & vertex : frame) {
+            this->texels.push_back(glm::vec4(vertex.position, 1.0f));
+            this->texels.push_back(glm::vec4(vertex.normal, 0.0f));
+        }
+    }
+    this->dirty = true;
+
+    return this->clips.size() - 1;
+}
+
+// the buffer is rebuilt from all clips, clips may be added after the first upload
+void VertexAnimation::upload() {
+    if (this->buffer == 0) {
+        glGenBuffers(1, &this->buffer);
+        glGenTextures(1, &this->texture);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->texels.size() * sizeof(glm::vec4), this->texels.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + VertexAnimation::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->buffer);
+
+    this->dirty = false;
+}
+
+void VertexAnimation::bind(Shader * shader) {
+    if (shader == nullptr || this->clips.empty()) return;
+
+    if (this->dirty) this->upload();
+
+    glActiveTexture(GL_TEXTURE0 + VertexAnimation::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader->setInt("animationFrames", VertexAnimation::TEXTURE_UNIT);
+    shader->setInt("animationVertices", this->numberOfVertices);
+    shader->setFloat("animationTime", static_cast<float>(SDL_GetTicks()) / 1000.0f);
+    for (size_t i=0;i<this->clips.size();i++)
+        shader->setVec3("animationClips[" + std::to_string(i) + "]", this->clips[i]);
+}
+
+void VertexAnimation::cleanUp() {
+    if (this->texture != 0) glDeleteTextures(1, &this->texture);
+    if (this->buffer != 0) glDeleteBuffers(1, &this->buffer);
+    this->texture = 0;
+    this->buffer = 0;
+}
+
+VertexAnimation::~VertexAnimation() {
+    this->cleanUp();
+}
+
+constexpr float VertexAnimation::BAKE_RATE;
@@ -0,0 +1,145 @@
+#include "state.hpp"
+
+StaticBatch::StaticBatch(Shader * shader, Mesh * source, GLushort materialIndex) {
+    this->shader = shader;
+    this->materialIndex = materialIndex;
+
+    for (auto & texture : source->getTextures()) this->mesh.addTexture(texture);
+    this->mesh.setUseNormalsTexture(source->isUsingNormalsTexture());
+    this->mesh.setOpacity(source->getOpacity());
+}
+
+void StaticBatch::add(Mesh * source, const glm::mat4 & transformation) {
+    const glm::mat3 rotation = glm::mat3(transformation);
+    const unsigned int offset = this->mesh.vertices.size();
+
+    for (auto & vertex : source->vertices) {
+        Vertex transformed(glm::vec3(transformation * glm::vec4(vertex.position, 1.0f)));
+        transformed.normal = rotation * vertex.normal;
+        transformed.uv = vertex.uv;
+        transformed.tangent = rotation * vertex.tangent;
+        transformed.bitangent = rotation * vertex.bitangent;
+
+        this->min = glm::min(this->min, transformed.position);
+        this->max = glm::max(this->max, transformed.position);
+
+        this->mesh.vertices.push_back(transformed);
+    }
+
+    for (auto index : source->indices) this->mesh.indices.push_back(offset + index);
+}
+
+void StaticBatch::init() {
+    this->mesh.init();
+
+    std::vector<GLushort> materialIndices = { this->materialIndex };
+    this->mesh.setMaterialIndices(materialIndices);
+
+    std::vector<InstanceTransform> instanceTransforms = { InstanceTransform() };
+    this->mesh.setInstanceTransforms(instanceTransforms);
+}
+
+void StaticBatch::render() {
+    if (this->shader == nullptr || !Camera::instance()->isInFrustum(this->min, this->max)) return;
+
+    Shader * variant = this->mesh.selectShader(this->shader);
+    variant->use();
+    if (variant->isBeingUsed()) {
+        variant->setSceneUniforms();
+
+        this->mesh.render(variant);
+
+        variant->stopUse();
+    }
+}
+
+void StaticBatch::renderDepth(Shader * shader, const bool cull) {
+    if (this->isTranslucent()) return;
+    if (cull && !Camera::instance()->isInFrustum(this->min, this->max)) return;
+
+    this->mesh.render(shader, false);
+}
+
+void StaticBatch::cleanUp() {
+    this->mesh.cleanUp();
+}
+
+/*
+ * Merges the meshes of all static renderables sharing shader, textures and material
+ * into one pre-transformed mesh per grid cell, the cells keeping the batches cullable
+ */
+void StaticBatcher::bake() {
+    this->cleanUp();
+
+    for (auto & renderable : this->content) {
+        const glm::mat4 transformation = renderable->calculateTransformationMatrix();
+        const glm::ivec3 cell = glm::ivec3(glm::floor(renderable->getPosition() / StaticBatcher::CELL_SIZE));
+
+        for (auto & mesh : renderable->getMeshes()) {
+            std::string key = std::to_string(reinterpret_cast<uintptr_t>(renderable->getShader())) + "|" +
+                std::to_string(renderable->getMaterialIndex()) + "|" + std::to_string(mesh->isUsingNormalsTexture()) + "|" +
+                std::to_string(mesh->getOpacity()) + "|" + glm::to_string(cell);
+            for (auto & texture : mesh->getTextures()) key += "|" + std::to_string(reinterpret_cast<uintptr_t>(texture.get()));
+
+            StaticBatch * batch = this->batches[key];
+            if (batch == nullptr) {
+                batch = new StaticBatch(renderable->getShader(), mesh, renderable->getMaterialIndex());
+                this->batches[key] = batch;
+            }
+            batch->add(mesh, transformation);
+        }
+    }
+
+    for (auto & batchEntry : this->batches) batchEntry.second->init();
+
+    this->baked = true;
+}
+
+void StaticBatcher::addRenderable(Renderable * renderable) {
+    if (renderable == nullptr) return;
+
+    this->content.push_back(renderable);
+    this->baked = false;
+}
+
+void StaticBatcher::render() {
+    if (this->content.empty()) return;
+
+    if (!this->baked) this->bake();
+
+    for (auto & batchEntry : this->batches)
+        if (!batchEntry.second->isTranslucent()) batchEntry.second->render();
+}
+
+void StaticBatcher::renderTranslucent() {
+    if (this->content.empty()) return;
+
+    if (!this->baked) this->bake();
+
+    for (auto & batchEntry : this->batches)
+        if (batchEntry.second->isTranslucent()) batchEntry.second->render();
+}
+
+void StaticBatcher::renderDepth(Shader * shader, const bool cull) {
+    if (this->content.empty()) return;
+
+    if (!this->baked) this->bake();
+
+    for (auto & batchEntry : this->batches) batchEntry.second->renderDepth(shader, cull);
+}
+
+void StaticBatcher::cleanUp() {
+    for (auto & batchEntry : this->batches) {
+        batchEntry.second->cleanUp();
+        delete batchEntry.second;
+    }
+    this->batches.clear();
+}
+
+StaticBatcher::~StaticBatcher() {
+    this->cleanUp();
+
+    for (auto * renderable : this->content) delete renderable;
+}
+
+constexpr float StaticBatcher::CELL_SIZE;
@@ -120,6 +120,25 @@ glm::mat4 Camera::getViewMatrix() {
                     this->upVector);
 }
 
+bool Camera::isInFrustum(const glm::vec3 & min, const glm::vec3 & max) {
+    const glm::mat4 clip = glm::transpose(this->getPerspective() * this->getViewMatrix());
+
+    // left, right, bottom, top, near, far planes (Gribb/Hartmann)
+    const glm::vec4 planes[6] = {
+        clip[3] + clip[0], clip[3] - clip[0],
+        clip[3] + clip[1], clip[3] - clip[1],
+        clip[3] + clip[2], clip[3] - clip[2]
+    };
+
+    for (auto & plane : planes) {
+        const glm::vec3 positiveVertex(
+            plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), positiveVertex) + plane.w < 0) return false;
+    }
+
+    return true;
+}
+
 float Camera::getFieldOfViewY() {
     return this->fovy;
 }
@@ -0,0 +1,88 @@
+#include "render.hpp"
+
+/*
+ * Blits the depth of the bound draw framebuffer into a texture of the same format, blits between
+ * depth formats are not allowed. Multisampled framebuffers would need a resolve and are left alone
+ */
+bool DepthCopy::copy() {
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint sampleBuffers = 0;
+    glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+    if (viewport[2] <= 0 || viewport[3] <= 0 || sampleBuffers > 0) return false;
+
+    const GLenum attachment = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+    GLint type = GL_NONE;
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+    if (type == GL_NONE) return false;
+
+    GLint depthSize = 0, stencilSize = 0, componentType = GL_NONE;
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthSize);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilSize);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+    if (depthSize == 0) return false;
+
+    GLenum format = GL_DEPTH_COMPONENT24;
+    if (stencilSize > 0) format = componentType == GL_FLOAT ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+    else if (componentType == GL_FLOAT) format = GL_DEPTH_COMPONENT32F;
+    else if (depthSize == 16) format = GL_DEPTH_COMPONENT16;
+    else if (depthSize == 32) format = GL_DEPTH_COMPONENT32;
+
+    // grows only, resolution scaling changes the viewport from frame to frame
+    const GLsizei width = viewport[0] + viewport[2], height = viewport[1] + viewport[3];
+    if (format != this->format || width > this->width || height > this->height) {
+        if (this->texture == 0) glGenTextures(1, &this->texture);
+        if (this->framebuffer == 0) glGenFramebuffers(1, &this->framebuffer);
+
+        this->width = std::max(width, this->width);
+        this->height = std::max(height, this->height);
+        this->format = format;
+
+        const bool withStencil = stencilSize > 0;
+        glBindTexture(GL_TEXTURE_2D, this->texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, this->width, this->height, 0,
+            withStencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT,
+            withStencil ? (componentType == GL_FLOAT ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_UNSIGNED_INT_24_8) : GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->framebuffer);
+        this->attach();
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->framebuffer);
+    glBlitFramebuffer(viewport[0], viewport[1], width, height, viewport[0], viewport[1], width, height,
+        GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    return true;
+}
+
+void DepthCopy::attach() {
+    if (this->texture == 0) return;
+
+    const bool withStencil = this->format == GL_DEPTH24_STENCIL8 || this->format == GL_DEPTH32F_STENCIL8;
+    // a stencil attached along with an earlier format must not stay behind
+    if (!withStencil) glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, withStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+        GL_TEXTURE_2D, this->texture, 0);
+}
+
+void DepthCopy::cleanUp() {
+    if (this->texture != 0) glDeleteTextures(1, &this->texture);
+    if (this->framebuffer != 0) glDeleteFramebuffers(1, &this->framebuffer);
+
+    this->texture = 0;
+    this->framebuffer = 0;
+    this->width = 0;
+    this->height = 0;
+    this->format = GL_NONE;
+}
+
+DepthCopy::~DepthCopy() {
+    this->cleanUp();
+}
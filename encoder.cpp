@@ -0,0 +1,360 @@
+#include "render.hpp"
+
+#include <sys/stat.h>
+
+static const char CACHE_MAGIC[4] = { 'G', 'T', 'B', 'C' };
+static const uint32_t CACHE_VERSION = 1;
+
+static void writeUint16(unsigned char * out, const unsigned int value) {
+    out[0] = value & 0xff;
+    out[1] = (value >> 8) & 0xff;
+}
+
+static unsigned int toRgb565(const int r, const int g, const int b) {
+    return ((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255);
+}
+
+static glm::ivec3 fromRgb565(const unsigned int color) {
+    const int r = (color >> 11) & 31;
+    const int g = (color >> 5) & 63;
+    const int b = color & 31;
+    return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+/*
+ * BC1 color block: bounding box end points inset by 1/16th, every pixel picks the closest of the 4 palette colors
+ */
+static void encodeColorBlock(const unsigned char * block, unsigned char * out) {
+    glm::ivec3 min(255), max(0);
+    for (int i=0;i<16;i++) {
+        const glm::ivec3 color(block[i * 4], block[i * 4 + 1], block[i * 4 + 2]);
+        min = glm::min(min, color);
+        max = glm::max(max, color);
+    }
+
+    const glm::ivec3 inset = (max - min) / 16;
+    min = glm::min(min + inset, glm::ivec3(255));
+    max = glm::max(max - inset, glm::ivec3(0));
+
+    unsigned int color0 = toRgb565(max.r, max.g, max.b);
+    unsigned int color1 = toRgb565(min.r, min.g, min.b);
+    if (color0 < color1) std::swap(color0, color1);
+
+    writeUint16(out, color0);
+    writeUint16(out + 2, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        const glm::ivec3 end0 = fromRgb565(color0);
+        const glm::ivec3 end1 = fromRgb565(color1);
+        const glm::ivec3 palette[4] = { end0, end1, (2 * end0 + end1) / 3, (end0 + 2 * end1) / 3 };
+
+        for (int i=0;i<16;i++) {
+            const glm::ivec3 color(block[i * 4], block[i * 4 + 1], block[i * 4 + 2]);
+            int best = 0, bestDistance = INT_MAX;
+            for (int p=0;p<4;p++) {
+                const glm::ivec3 delta = color - palette[p];
+                const int distance = delta.r * delta.r + delta.g * delta.g + delta.b * delta.b;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    for (int i=0;i<4;i++) out[4 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+/*
+ * BC4 block for one channel (BC3 alpha, BC5 red and green) in the 8 value mode
+ */
+static void encodeChannelBlock(const unsigned char * block, const int channel, unsigned char * out) {
+    int min = 255, max = 0;
+    for (int i=0;i<16;i++) {
+        min = std::min(min, static_cast<int>(block[i * 4 + channel]));
+        max = std::max(max, static_cast<int>(block[i * 4 + channel]));
+    }
+
+    out[0] = max;
+    out[1] = min;
+
+    uint64_t indices = 0;
+    if (max != min) {
+        int palette[8] = { max, min };
+        for (int p=2;p<8;p++) palette[p] = ((8 - p) * max + (p - 1) * min) / 7;
+
+        for (int i=0;i<16;i++) {
+            const int value = block[i * 4 + channel];
+            int best = 0, bestDistance = INT_MAX;
+            for (int p=0;p<8;p++) {
+                const int distance = std::abs(value - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (i * 3);
+        }
+    }
+
+    for (int i=0;i<6;i++) out[2 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+static TextureLevel encodeLevel(const TextureLevel & rgba, const GLenum format) {
+    const int blockSize = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+    const int blocksX = (rgba.width + 3) / 4;
+    const int blocksY = (rgba.height + 3) / 4;
+
+    TextureLevel level;
+    level.width = rgba.width;
+    level.height = rgba.height;
+    level.data.resize(blocksX * blocksY * blockSize);
+
+    unsigned char block[64];
+    unsigned char * out = level.data.data();
+    for (int by=0;by<blocksY;by++) {
+        for (int bx=0;bx<blocksX;bx++) {
+            // edge blocks repeat the last row/column
+            for (int y=0;y<4;y++) {
+                for (int x=0;x<4;x++) {
+                    const int px = std::min(bx * 4 + x, rgba.width - 1);
+                    const int py = std::min(by * 4 + y, rgba.height - 1);
+                    memcpy(block + (y * 4 + x) * 4, &rgba.data[(py * rgba.width + px) * 4], 4);
+                }
+            }
+
+            if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) encodeColorBlock(block, out);
+            else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                encodeChannelBlock(block, 3, out);
+                encodeColorBlock(block, out + 8);
+            } else {
+                encodeChannelBlock(block, 0, out);
+                encodeChannelBlock(block, 1, out + 8);
+            }
+            out += blockSize;
+        }
+    }
+
+    return level;
+}
+
+/*
+ * 2x2 box filter, normal maps get renormalized
+ */
+static TextureLevel downsample(const TextureLevel & source, const bool normalMap) {
+    TextureLevel level;
+    level.width = std::max(1, source.width / 2);
+    level.height = std::max(1, source.height / 2);
+    level.data.resize(level.width * level.height * 4);
+
+    for (int y=0;y<level.height;y++) {
+        for (int x=0;x<level.width;x++) {
+            glm::vec4 sum(0.0f);
+            for (int s=0;s<4;s++) {
+                const int sx = std::min(x * 2 + (s & 1), source.width - 1);
+                const int sy = std::min(y * 2 + (s >> 1), source.height - 1);
+                const unsigned char * texel = &source.data[(sy * source.width + sx) * 4];
+                sum += glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+            }
+            glm::vec4 average = sum / 4.0f;
+
+            if (normalMap) {
+                const glm::vec3 normal = glm::vec3(average) / 127.5f - 1.0f;
+                const float length = glm::length(normal);
+                if (length > 0.0f) average = glm::vec4((normal / length + 1.0f) * 127.5f, average.a);
+            }
+
+            unsigned char * texel = &level.data[(y * level.width + x) * 4];
+            for (int c=0;c<4;c++) texel[c] = static_cast<unsigned char>(glm::clamp(glm::round(average[c]), 0.0f, 255.0f));
+        }
+    }
+
+    return level;
+}
+
+bool TextureEncoder::isSupported() {
+    return GLEW_EXT_texture_compression_s3tc;
+}
+
+GLint TextureEncoder::getBlockSize(const GLenum format) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+std::vector<TextureLevel> TextureEncoder::encode(SDL_Surface * surface, const bool normalMap, GLenum & format) {
+    std::vector<TextureLevel> levels;
+    if (surface == nullptr) return levels;
+
+    SDL_Surface * rgbaSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    if (rgbaSurface == nullptr) return levels;
+
+    TextureLevel rgba;
+    rgba.width = rgbaSurface->w;
+    rgba.height = rgbaSurface->h;
+    rgba.data.resize(rgba.width * rgba.height * 4);
+
+    bool translucent = false;
+    SDL_LockSurface(rgbaSurface);
+    for (int y=0;y<rgba.height;y++) {
+        const unsigned char * row = static_cast<const unsigned char *>(rgbaSurface->pixels) + y * rgbaSurface->pitch;
+        memcpy(&rgba.data[y * rgba.width * 4], row, rgba.width * 4);
+        for (int x=0;x<rgba.width && !translucent;x++) translucent = row[x * 4 + 3] != 255;
+    }
+    SDL_UnlockSurface(rgbaSurface);
+    SDL_FreeSurface(rgbaSurface);
+
+    if (normalMap) format = GL_COMPRESSED_RG_RGTC2;
+    else if (translucent) format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    while (true) {
+        levels.push_back(encodeLevel(rgba, format));
+        if (rgba.width == 1 && rgba.height == 1) break;
+        rgba = downsample(rgba, normalMap);
+    }
+
+    return levels;
+}
+
+static bool getSourceStamp(const std::string & path, uint64_t & size, int64_t & time) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+
+    size = static_cast<uint64_t>(info.st_size);
+    time = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+std::string TextureEncoder::getCachePath(const std::string & path) {
+    return path + ".bc";
+}
+
+/*
+ * Validates the cache header against the source image and leaves the stream at the first level
+ */
+static bool openCache(const std::string & path, std::ifstream & file, GLenum & format, uint32_t & numberOfLevels) {
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if (path.empty() || !getSourceStamp(path, sourceSize, sourceTime)) return false;
+
+    file.open(TextureEncoder::getCachePath(path).c_str(), std::ios::binary);
+    if (!file.is_open()) return false;
+
+    char magic[4];
+    uint32_t version = 0, cachedFormat = 0;
+    uint64_t cachedSize = 0;
+    int64_t cachedTime = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&cachedFormat), sizeof(cachedFormat));
+    file.read(reinterpret_cast<char *>(&cachedSize), sizeof(cachedSize));
+    file.read(reinterpret_cast<char *>(&cachedTime), sizeof(cachedTime));
+    file.read(reinterpret_cast<char *>(&numberOfLevels), sizeof(numberOfLevels));
+
+    // a changed source image invalidates the cache
+    if (!file.good() || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || version != CACHE_VERSION ||
+            cachedSize != sourceSize || cachedTime != sourceTime || numberOfLevels == 0) return false;
+
+    format = cachedFormat;
+
+    return true;
+}
+
+static bool readLevel(std::ifstream & file, TextureLevel & level, const GLsizei maxSize) {
+    uint32_t width = 0, height = 0, size = 0;
+    file.read(reinterpret_cast<char *>(&width), sizeof(width));
+    file.read(reinterpret_cast<char *>(&height), sizeof(height));
+    file.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!file.good() || size == 0) return false;
+
+    level.width = width;
+    level.height = height;
+
+    if (std::max(level.width, level.height) > maxSize) {
+        level.data.clear();
+        file.seekg(size, std::ios::cur);
+        return file.good();
+    }
+
+    level.data.resize(size);
+    file.read(reinterpret_cast<char *>(level.data.data()), size);
+
+    return file.good();
+}
+
+/*
+ * Levels larger than maxSize are only described, their data is left on disk for streaming
+ */
+bool TextureEncoder::loadCache(const std::string & path, GLenum & format, std::vector<TextureLevel> & levels, const GLsizei maxSize) {
+    std::ifstream file;
+    GLenum cachedFormat = 0;
+    uint32_t numberOfLevels = 0;
+    if (!openCache(path, file, cachedFormat, numberOfLevels)) return false;
+
+    std::vector<TextureLevel> cachedLevels(numberOfLevels);
+    for (auto & level : cachedLevels)
+        if (!readLevel(file, level, maxSize)) return false;
+
+    format = cachedFormat;
+    levels = std::move(cachedLevels);
+
+    return true;
+}
+
+/*
+ * Reads one level straight into destination, e.g. a mapped pixel buffer
+ */
+bool TextureEncoder::loadCacheLevel(const std::string & path, const GLint level, unsigned char * destination, const size_t size) {
+    std::ifstream file;
+    GLenum format = 0;
+    uint32_t numberOfLevels = 0;
+    if (destination == nullptr || !openCache(path, file, format, numberOfLevels) ||
+            level < 0 || level >= static_cast<GLint>(numberOfLevels)) return false;
+
+    TextureLevel textureLevel;
+    for (GLint l=0;l<level;l++)
+        if (!readLevel(file, textureLevel, 0)) return false;
+
+    uint32_t width = 0, height = 0, levelSize = 0;
+    file.read(reinterpret_cast<char *>(&width), sizeof(width));
+    file.read(reinterpret_cast<char *>(&height), sizeof(height));
+    file.read(reinterpret_cast<char *>(&levelSize), sizeof(levelSize));
+    if (!file.good() || levelSize != size) return false;
+
+    file.read(reinterpret_cast<char *>(destination), size);
+
+    return file.good();
+}
+
+bool TextureEncoder::saveCache(const std::string & path, const GLenum format, const std::vector<TextureLevel> & levels) {
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if (path.empty() || levels.empty() || !getSourceStamp(path, sourceSize, sourceTime)) return false;
+
+    const std::string cachePath = TextureEncoder::getCachePath(path);
+    std::ofstream file(cachePath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Unable to write texture cache: " << cachePath << std::endl;
+        return false;
+    }
+
+    const uint32_t cachedFormat = format;
+    const uint32_t numberOfLevels = levels.size();
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char *>(&CACHE_VERSION), sizeof(CACHE_VERSION));
+    file.write(reinterpret_cast<const char *>(&cachedFormat), sizeof(cachedFormat));
+    file.write(reinterpret_cast<const char *>(&sourceSize), sizeof(sourceSize));
+    file.write(reinterpret_cast<const char *>(&sourceTime), sizeof(sourceTime));
+    file.write(reinterpret_cast<const char *>(&numberOfLevels), sizeof(numberOfLevels));
+
+    for (auto & level : levels) {
+        const uint32_t width = level.width, height = level.height, size = level.data.size();
+        file.write(reinterpret_cast<const char *>(&width), sizeof(width));
+        file.write(reinterpret_cast<const char *>(&height), sizeof(height));
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char *>(level.data.data()), size);
+    }
+
+    return file.good();
+}
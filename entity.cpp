@@ -11,23 +11,34 @@ Entity::Entity(Model * model, Shader * shader) : Entity(model) {
     this->useShader(shader);
 }
 
-void Entity::setMaterials(std::vector<Material> & materials) {
-    if (this->model != nullptr) this->model->setMaterials(materials);
+void Entity::setMaterialIndices(std::vector<GLushort> & materialIndices) {
+    if (this->model != nullptr) this->model->setMaterialIndices(materialIndices);
 }
 
-void Entity::setModelMatrices(std::vector<glm::mat4> & modelMatrices) {
-    if (this->model != nullptr) this->model->setModelMatrices(modelMatrices);
+void Entity::setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations) {
+    if (this->model != nullptr) this->model->setInstanceAnimations(instanceAnimations);
+}
+
+void Entity::setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) {
+    if (this->model != nullptr) this->model->setInstanceTransforms(instanceTransforms);
 }
 
 void Entity::render() {
-    if (this->model == nullptr || this->shader == nullptr) return;
+    if (this->model == nullptr || this->getShader() == nullptr) return;
+
+    this->model->render(this->shader, false, this->depthPrePassed);
+}
+
+void Entity::renderTranslucent() {
+    if (this->model == nullptr || this->getShader() == nullptr) return;
+
+    this->model->render(this->shader, true);
+}
 
-    this->shader->use();
-	if (this->shader->isBeingUsed()) {
-	    this->model->render(this->shader);
-	    this->shader->stopUse();
-	}
+std::vector<Mesh *> Entity::getMeshes() {
+    if (this->model == nullptr) return std::vector<Mesh *>();
 
+    return this->model->getMeshes();
 }
 
 void Entity::cleanUp() { if (this->model != nullptr) this->model->cleanUp(); }
@@ -1,7 +1,8 @@
 #include "game.hpp"
 
-Game::Game(std::string root) {
+Game::Game(std::string root, const RenderPath renderPath) {
     this->root = root;
+    this->renderPath = renderPath;
     if (this->root[static_cast<int>(root.length())-1] != '/') this->root.append("/");
     this->factory = ModelFactory::instance(this->root);
 
@@ -63,16 +64,18 @@ bool Game::init() {
                 if (GLEW_OK != err) {
                     std::cerr << "GLEW could not be initialized! Error: "
                             << glewGetErrorString(err) << std::endl;
-                }
+                } else ShaderRegistry::instance()->enableParallelCompile();
             }
         }
     }
 
     TTF_Init();
 
-    this->state = new GameState(this->root);
+    this->state = new GameState(this->root, this->renderPath);
     this->state->init();
 
+    this->resolution = new DynamicResolution(ShaderRegistry::instance()->getShader(this->root + "/res/shaders/upscale"));
+
     return true;
 }
 
@@ -175,7 +178,14 @@ void Game::run() {
 
         this->camera->updateYlocation(elapsed / FIXED_DRAW_INTERVAL);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        TextureStreamer::instance()->update();
+        TextureUploader::instance()->update();
+        TextureArrays::instance()->generateMipmaps();
+        this->resolution->begin(this->width, this->height);
+        LightClusters::instance()->update();
+        ParticleSystem::instance()->update();
         this->state->render();
+        this->resolution->end();
         SDL_GL_SwapWindow(window);
     }
 
@@ -198,6 +208,7 @@ void Game::resize(int width, int height) {
     this->width = width;
     this->height = height;
 
+    // the offscreen scene framebuffer follows the window size on the next frame
     glViewport(0,0,(GLsizei)this->width,(GLsizei)this->height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
@@ -207,10 +218,57 @@ Game::~Game() {
     if (this->world != nullptr) delete this->world;
     if (this->factory != nullptr) delete this->factory;
     if (this->state != nullptr) delete this->state;
+    if (this->resolution != nullptr) delete this->resolution;
+    delete RenderStatistics::instance();
+    delete LightClusters::instance();
+    delete ShadowCascades::instance();
+    delete ParticleSystem::instance();
+    delete TextureUploader::instance();
+    delete TextureRegistry::instance();
+    delete TextureStreamer::instance();
+    delete TextureArrays::instance();
+    delete MaterialPalette::instance();
+    delete ShaderRegistry::instance();
 
     cleanUp();
 }
 
+/*
+ * The cyborg comes without a skeleton, a baked clip that leans it from side to side,
+ * more the higher up a vertex is, stands in for an imported animation
+ */
+void Game::createSwayAnimation(Model * model) {
+    std::vector<Mesh *> meshes = model->getMeshes();
+
+    float bottom = std::numeric_limits<float>::max(), top = -std::numeric_limits<float>::max();
+    for (auto * mesh : meshes) {
+        for (auto & vertex : mesh->vertices) {
+            bottom = std::min(bottom, vertex.position.y);
+            top = std::max(top, vertex.position.y);
+        }
+    }
+    if (top <= bottom) return;
+
+    const size_t numberOfFrames = 2 * static_cast<size_t>(VertexAnimation::BAKE_RATE);
+    for (auto * mesh : meshes) {
+        std::vector<std::vector<Vertex>> frames(numberOfFrames, mesh->vertices);
+        for (size_t f=0;f<numberOfFrames;f++) {
+            const float lean = glm::radians(6.0f) * glm::sin(glm::two_pi<float>() * f / numberOfFrames);
+
+            for (auto & vertex : frames[f]) {
+                const float height = (vertex.position.y - bottom) / (top - bottom);
+                const glm::quat rotation = glm::angleAxis(lean * height, glm::vec3(0, 0, 1));
+                vertex.position = glm::vec3(0.0f, bottom, 0.0f) + rotation * (vertex.position - glm::vec3(0.0f, bottom, 0.0f));
+                vertex.normal = rotation * vertex.normal;
+            }
+        }
+
+        std::shared_ptr<VertexAnimation> animation(new VertexAnimation(mesh->vertices.size()));
+        if (animation->addClip(frames) < 0) continue;
+        mesh->setAnimation(animation);
+    }
+}
+
 void Game::createTestModels() {
 
     glEnable(GL_CULL_FACE);
@@ -248,22 +306,40 @@ void Game::createTestModels() {
 
     Model * nanosuitModel(this->factory->createModel("/res/models/cyborg.obj"));
     if (nanosuitModel != nullptr && nanosuitModel->hasBeenLoaded()) {
+        nanosuitModel->createImpostor();
+        this->createSwayAnimation(nanosuitModel);
         for (int j=0;j<20000;j++) {
             Entity * nanosuit = new Entity(nanosuitModel);
-            nanosuit->useShader(new Shader(this->root + "/res/shaders/textures"));
+            nanosuit->useShader(ShaderRegistry::instance()->getShader(this->root + "/res/shaders/textures"));
             nanosuit->setColor(1.0f,1.0f,1.0f,1.0f);
+            nanosuit->setAnimation(0, j * 0.37f);
             nanosuit->setPosition(4.0f + 10*j, 5.0f, -15.0f);
             nanosuit->setScaleFactor(2.0f);
             this->state->addRenderable(nanosuit);
         }
     }
 
+    Model * ghostModel(this->factory->createModel("/res/models/nanosuit.obj"));
+    if (ghostModel != nullptr && ghostModel->hasBeenLoaded()) {
+        ghostModel->setOpacity(0.35f);
+        for (int j=0;j<2000;j++) {
+            Entity * ghost = new Entity(ghostModel);
+            ghost->useShader(ShaderRegistry::instance()->getShader(this->root + "/res/shaders/textures"));
+            ghost->setColor((j % 3) == 0 ? 1.0f : 0.5f, (j % 3) == 1 ? 1.0f : 0.5f, (j % 3) == 2 ? 1.0f : 0.5f, 1.0f);
+            ghost->setPosition(4.0f + 3*(j % 40), 0.0f, -40.0f - 3*(j / 40));
+            ghost->setRotation(0, (j * 37) % 360, 0);
+            ghost->setScaleFactor(0.5f);
+            this->state->addRenderable(ghost);
+        }
+    }
+
     for (int j=0;j<1;j++) {
         Renderable * rock = this->factory->createImage("/res/models/rock.png");
         if (rock->hasBeenInitialized()) {
             rock->setPosition(25.0f + 10*j, 5.0f, -5.0f + 20*j);
             rock->setRotation(0, 90, 0);
             rock->setScaleFactor(0.01f);
+            rock->setStatic(true);
             this->state->addRenderable(rock);
         }
     }
@@ -275,19 +351,41 @@ void Game::createTestModels() {
             sign->setColor(1.0f,1.0f,1.0f,1.0f);
             sign->setRotation(0, -90, 0);
             sign->setScaleFactor(0.05f);
+            sign->setStatic(true);
             this->state->addRenderable(sign);
         }
     }
 
+    for (int j=0;j<200;j++) {
+        const glm::vec3 color = glm::vec3((j % 3) == 0 ? 1.0f : 0.2f, (j % 3) == 1 ? 1.0f : 0.2f, (j % 3) == 2 ? 1.0f : 0.2f);
+        World::instance()->addPointLight(PointLight(glm::vec3(4.0f + 20*j, 8.0f, -10.0f), color, 15.0f));
+    }
+    World::instance()->addSpotLight(
+        SpotLight(glm::vec3(4.0f, 20.0f, -15.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f), 40.0f, glm::radians(15.0f), glm::radians(25.0f)));
+
+    for (int j=0;j<4;j++) {
+        ParticleEmitter fountain;
+        fountain.position = glm::vec3(-10.0f + 30*j, 0.0f, -30.0f);
+        fountain.speed = 12.0f;
+        fountain.rate = 50000.0f;
+        fountain.lifetime = 2.5f;
+        fountain.size = 0.08f;
+        ParticleSystem::instance()->spawn(fountain);
+    }
 }
-std::map<std::string, std::shared_ptr<Texture>> Game::TEXTURES;
 
 
 int main(int argc, char **argv) {
-    Game game((argc > 1) ? std::string(argv[1]) : "./");
-    if (game.init()) game.run();
+    std::string root = "./";
+    RenderPath renderPath = RENDER_PATH_FORWARD;
+    for (int i=1;i<argc;i++) {
+        const std::string arg(argv[i]);
+        if (arg == "--deferred") renderPath = RENDER_PATH_DEFERRED;
+        else root = arg;
+    }
 
-    Game::TEXTURES.clear();
+    Game game(root, renderPath);
+    if (game.init()) game.run();
 
     TTF_Quit();
 
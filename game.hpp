@@ -8,6 +8,7 @@
 class Game {
     private:
         std::string root = "./";
+        RenderPath renderPath = RENDER_PATH_FORWARD;
 
         int width = DEFAULT_WIDTH;
         int height = DEFAULT_HEIGHT;
@@ -17,6 +18,7 @@ class Game {
         bool quit = false;
 
         GameState * state = nullptr;
+        DynamicResolution * resolution = nullptr;
 
         SDL_Window * window = nullptr;
         SDL_GLContext glContext = nullptr;
@@ -28,9 +30,10 @@ class Game {
 
         void clearScreen(float r, float g, float b, float a);
         void cleanUp();
+        void createSwayAnimation(Model * model);
 
     public:
-        Game(std::string root);
+        Game(std::string root, const RenderPath renderPath = RENDER_PATH_FORWARD);
         std::string getRoot() { return this->root; }
         bool init();
         void run();
@@ -39,7 +42,6 @@ class Game {
         float getLastFrameDuration() const;
         virtual ~Game();
         void createTestModels();
-        static std::map<std::string, std::shared_ptr<Texture>> TEXTURES;
 };
 
 #endif
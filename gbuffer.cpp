@@ -0,0 +1,141 @@
+#include "render.hpp"
+
+bool GBuffer::create(const GLsizei width, const GLsizei height) {
+    this->cleanUp();
+
+    const GLint internalFormats[GBuffer::NUMBER_OF_TARGETS] = { GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_RGBA8 };
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+
+    glGenTextures(GBuffer::NUMBER_OF_TARGETS, this->textures);
+    std::vector<GLenum> drawBuffers;
+    for (int i=0;i<GBuffer::NUMBER_OF_TARGETS;i++) {
+        glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, this->textures[i], 0);
+        drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+    }
+
+    glGenTextures(1, &this->depthTexture);
+    glBindTexture(GL_TEXTURE_2D, this->depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthTexture, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDrawBuffers(drawBuffers.size(), &drawBuffers[0]);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "G-buffer is incomplete: " << status << std::endl;
+        this->cleanUp();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+
+    return true;
+}
+
+/*
+ * Grows with the viewport, then binds and clears the G-buffer for the geometry passes.
+ * The viewport changes every few frames under dynamic resolution, so it is not shrunk
+ */
+bool GBuffer::begin() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] <= 0 || viewport[3] <= 0) return false;
+
+    // read before create() leaves framebuffer 0 bound
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &this->previousFramebuffer);
+
+    if ((viewport[2] > this->width || viewport[3] > this->height) &&
+            !this->create(std::max(viewport[2], this->width), std::max(viewport[3], this->height))) {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->previousFramebuffer);
+        return false;
+    }
+
+    this->viewportWidth = viewport[2];
+    this->viewportHeight = viewport[3];
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    return true;
+}
+
+void GBuffer::end() {
+    glBindFramebuffer(GL_FRAMEBUFFER, this->previousFramebuffer);
+}
+
+/*
+ * Lights every covered pixel once with a screen filling triangle and copies the G-buffer depth over
+ * so that everything drawn afterwards is still occluded
+ */
+void GBuffer::light(Shader * shader) {
+    if (shader == nullptr || this->framebuffer == 0) return;
+
+    shader->use();
+    if (!shader->isBeingUsed()) return;
+
+    const std::string samplers[GBuffer::NUMBER_OF_TARGETS] = { "gAlbedo", "gNormal", "gSpecular", "gAmbient" };
+    for (int i=0;i<GBuffer::NUMBER_OF_TARGETS;i++) {
+        glActiveTexture(GL_TEXTURE0 + GBuffer::TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+        shader->setInt(samplers[i], GBuffer::TEXTURE_UNIT + i);
+    }
+    glActiveTexture(GL_TEXTURE0 + GBuffer::TEXTURE_UNIT + GBuffer::NUMBER_OF_TARGETS);
+    glBindTexture(GL_TEXTURE_2D, this->depthTexture);
+    shader->setInt("gDepth", GBuffer::TEXTURE_UNIT + GBuffer::NUMBER_OF_TARGETS);
+    glActiveTexture(GL_TEXTURE0);
+
+    const glm::mat4 view = Camera::instance()->getViewMatrix();
+    shader->setMat4("view", view);
+    shader->setVec2("uvScale", glm::vec2(this->viewportWidth, this->viewportHeight) / glm::vec2(this->width, this->height));
+    shader->setMat4("inverseViewProjection", glm::inverse(Camera::instance()->getPerspective() * view));
+    shader->setVec3("sunDirection", World::instance()->getSunDirection());
+    shader->setVec3("sunLightColor", World::instance()->getSunLightColor());
+    shader->setVec3("eyePosition", Camera::instance()->getPosition());
+    LightClusters::instance()->bind(shader);
+    ShadowCascades::instance()->bind(shader);
+
+    if (this->vertexArray == 0) glGenVertexArrays(1, &this->vertexArray);
+
+    // depth is only written with the test enabled
+    glDepthFunc(GL_ALWAYS);
+    glBindVertexArray(this->vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+
+    shader->stopUse();
+}
+
+void GBuffer::cleanUp() {
+    if (this->framebuffer != 0) glDeleteFramebuffers(1, &this->framebuffer);
+    if (this->textures[0] != 0) glDeleteTextures(GBuffer::NUMBER_OF_TARGETS, this->textures);
+    if (this->depthTexture != 0) glDeleteTextures(1, &this->depthTexture);
+
+    this->framebuffer = 0;
+    for (auto & texture : this->textures) texture = 0;
+    this->depthTexture = 0;
+    this->width = 0;
+    this->height = 0;
+}
+
+GBuffer::~GBuffer() {
+    this->cleanUp();
+
+    if (this->vertexArray != 0) glDeleteVertexArrays(1, &this->vertexArray);
+}
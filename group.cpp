@@ -12,21 +12,48 @@ void RenderableGroup::addRenderable(Renderable * renderable) {
     if (renderable != nullptr) this->content.push_back(renderable);
 }
 
-void RenderableGroup::render() {
-    if (this->content.size() == 0) return;
-
+void RenderableGroup::setInstanceData() {
     Renderable * firstRenderable = this->content[0];
 
-    std::vector<Material> materials;
-    std::vector<glm::mat4> modelMatrices;
+    std::vector<GLushort> materialIndices;
+    std::vector<InstanceAnimation> instanceAnimations;
+    std::vector<InstanceTransform> instanceTransforms;
 
     for (auto & renderable : this->content) {
-        modelMatrices.push_back(renderable->calculateTransformationMatrix());
-        materials.push_back(renderable->getMaterial());
+        instanceTransforms.push_back(renderable->calculateInstanceTransform());
+        materialIndices.push_back(renderable->getMaterialIndex());
+        instanceAnimations.push_back(renderable->getAnimation());
     }
 
-    firstRenderable->setMaterials(materials);
-    firstRenderable->setModelMatrices(modelMatrices);
+    firstRenderable->setMaterialIndices(materialIndices);
+    firstRenderable->setInstanceAnimations(instanceAnimations);
+    firstRenderable->setInstanceTransforms(instanceTransforms);
+}
+
+void RenderableGroup::render(const bool depthPrePassed) {
+    if (this->content.size() == 0) return;
+
+    // a depth pass of this frame already computed them
+    if (!this->instanceDataSet) this->setInstanceData();
+    this->instanceDataSet = false;
+
+    this->content[0]->setDepthPrePassed(depthPrePassed);
+    this->content[0]->render();
+}
+
+void RenderableGroup::renderDepth(Shader * shader) {
+    if (this->content.size() == 0) return;
+
+    // shadow cascades and the depth pre-pass all draw the same instances as the shading pass
+    if (!this->instanceDataSet) this->setInstanceData();
+    this->instanceDataSet = true;
+
+    this->content[0]->renderDepth(shader);
+}
+
+void RenderableGroup::renderTranslucent() {
+    if (this->content.size() == 0) return;
 
-    firstRenderable->render();
+    // uploaded by the opaque passes of this frame
+    this->content[0]->renderTranslucent();
 }
@@ -5,24 +5,8 @@ Image * Image::fromFile(std::string file) {
     Image * img = new Image();
     img->id = file;
 
-    std::map<std::string, std::shared_ptr<Texture>>::iterator val(Game::TEXTURES.find(file));
-
-    if (val == Game::TEXTURES.end()) {
-        std::shared_ptr<Texture> texture(new Texture());
-        texture->setType(Model::DIFFUSE_TEXTURE);
-        texture->setPath(file);
-        texture->load();
-        if (texture->isValid()) Game::TEXTURES[file] = std::move(texture);
-        else {
-            texture.reset();
-            return img;
-        }
-    }
-
-    if (Game::TEXTURES[file]->isValid()) {
-        img->image = Game::TEXTURES[file]->getTextureSurface();
-        img->init();
-    }
+    img->texture = TextureRegistry::instance()->getTexture(file, Model::DIFFUSE_TEXTURE);
+    if (img->texture != nullptr) img->init();
 
     return img;
 }
@@ -45,7 +29,9 @@ Image * Image::fromText(std::string fontFile, std::string text, int size) {
         if (tmp != nullptr) {
 
             SDL_PixelFormat *format = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888);
-            img->image = SDL_ConvertSurface(tmp, format, 0);
+            img->texture.reset(new Texture());
+            img->texture->setType(Model::DIFFUSE_TEXTURE);
+            img->texture->setTextureSurface(SDL_ConvertSurface(tmp, format, 0));
 
             SDL_FreeFormat(format);
             SDL_FreeSurface(tmp);
@@ -60,17 +46,16 @@ Image * Image::fromText(std::string fontFile, std::string text, int size) {
 }
 
 void Image::init() {
-    if (this->image == nullptr) return;
+    if (this->texture == nullptr) return;
 
-    GLenum imageFormat;
-    if (!Texture::findImageFormat(this->image, &imageFormat)) {
+    if (!this->texture->isValid()) {
         std::cerr << "Unsupported Image Format: " << std::endl;
         return;
     }
 
     const float zDirNormal = -1.0f;
-    const float w = this->image->w;
-    const float h = this->image->h;
+    const float w = this->texture->getWidth();
+    const float h = this->texture->getHeight();
 
     Vertex one(glm::vec3(0.0f, h, 0.0f));
     one.uv = glm::vec2(1.0f, 0.0f);
@@ -100,71 +85,39 @@ void Image::init() {
     this->mesh.indices.push_back(2);
     this->mesh.indices.push_back(0);
 
-    glGenTextures(1, &this->textureId);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, this->textureId);
-
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, this->image->w, this->image->h, 0,
-                    imageFormat, GL_UNSIGNED_BYTE, this->image->pixels);
-    //glGenerateMipmap(GL_TEXTURE_2D);
-
+    // the mesh uploads and binds the texture, which also lets static images be batched like models
+    this->mesh.addTexture(this->texture);
     this->mesh.init();
 
     this->initialized = true;
 }
 
 void Image::render() {
-    if (this->shader == nullptr) return;
+    if (this->getShader() == nullptr) return;
 
-    this->shader->use();
-    if (this->shader->isBeingUsed()) {
+    Shader * variant = this->mesh.selectShader(this->shader);
+    variant->use();
+    if (variant->isBeingUsed()) {
+        variant->setSceneUniforms();
 
-        this->shader->setMat4("view", Camera::instance()->getViewMatrix());
-        this->shader->setMat4("projection", Camera::instance()->getPerspective());
+        this->mesh.render(variant);
 
-        this->shader->setVec3("ambientLight",  World::instance()->getAmbientLight());
-        this->shader->setVec3("sunDirection", World::instance()->getSunDirection());
-        this->shader->setVec3("sunLightColor", World::instance()->getSunLightColor());
-        this->shader->setVec3("eyePosition", Camera::instance()->getPosition());
-
-        this->shader->setInt("has_" + Model::AMBIENT_TEXTURE, 0);
-        this->shader->setInt("has_" + Model::SPECULAR_TEXTURE, 0);
-        this->shader->setInt("has_" + Model::TEXTURE_NORMALS, 0);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->textureId);
-        this->shader->setInt("has_" + Model::DIFFUSE_TEXTURE, 1);
-        this->shader->setInt(Model::DIFFUSE_TEXTURE, 0);
-
-        this->mesh.render(this->shader);
-
-        this->shader->stopUse();
+        variant->stopUse();
     }
 }
 
-void Image::setMaterials(std::vector<Material> & materials) {
-    this->mesh.setMaterials(materials);
+void Image::setMaterialIndices(std::vector<GLushort> & materialIndices) {
+    this->mesh.setMaterialIndices(materialIndices);
 }
 
-void Image::setModelMatrices(std::vector<glm::mat4> & modelMatrices) {
-    this->mesh.setModelMatrices(modelMatrices);
+void Image::setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) {
+    this->mesh.setInstanceTransforms(instanceTransforms);
 }
 
-void Image::cleanUp() {
-    glDeleteTextures(1, &this->textureId);
-    this->mesh.cleanUp();
+std::vector<Mesh *> Image::getMeshes() {
+    return std::vector<Mesh *> { &this->mesh };
 }
 
-Image::~Image() {
-    if (this->text.size() != 0 && this->image != nullptr) {
-        SDL_FreeSurface(this->image);
-        this->image = nullptr;
-    }
+void Image::cleanUp() {
+    this->mesh.cleanUp();
 }
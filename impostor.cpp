@@ -0,0 +1,247 @@
+#include "render.hpp"
+
+Impostor::Impostor(Shader * shader, const float distance) {
+    this->shader = shader;
+    this->distance = distance;
+}
+
+/*
+ * Octahedral mapping with +y in the center, the frames of the lower hemisphere fold out to the corners.
+ * impostor.vs encodes view directions the same way
+ */
+glm::vec3 Impostor::getFrameDirection(const int x, const int y) {
+    const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / static_cast<float>(Impostor::FRAMES) * 2.0f - 1.0f;
+
+    glm::vec3 direction(uv.x, 1.0f - glm::abs(uv.x) - glm::abs(uv.y), uv.y);
+    if (direction.y < 0.0f) {
+        const float folded[2] = { (1.0f - glm::abs(direction.z)) * (direction.x >= 0.0f ? 1.0f : -1.0f),
+                                  (1.0f - glm::abs(direction.x)) * (direction.z >= 0.0f ? 1.0f : -1.0f) };
+        direction.x = folded[0];
+        direction.z = folded[1];
+    }
+
+    return glm::normalize(direction);
+}
+
+/*
+ * Renders every frame with an orthographic camera on the bounding sphere looking at its center,
+ * the depth of the far side of the sphere is 1. The full detail meshes are drawn as a single instance
+ */
+bool Impostor::bake(const std::vector<Mesh *> & meshes, Shader * bakeShader) {
+    if (meshes.empty() || bakeShader == nullptr) return false;
+
+    bool hasVertices = false;
+    glm::vec3 min(0.0f), max(0.0f);
+    for (auto * mesh : meshes) {
+        for (auto & vertex : mesh->vertices) {
+            min = hasVertices ? glm::min(min, vertex.position) : vertex.position;
+            max = hasVertices ? glm::max(max, vertex.position) : vertex.position;
+            hasVertices = true;
+        }
+    }
+    if (!hasVertices) return false;
+
+    this->center = (min + max) / 2.0f;
+    this->radius = std::max(glm::length(max - min) / 2.0f, std::numeric_limits<float>::epsilon());
+
+    // the frame loop has not uploaded anything yet, the albedo would be baked from empty arrays
+    std::set<TextureArray *> arrays;
+    for (auto * mesh : meshes)
+        for (auto & texture : mesh->getTextures())
+            if (texture->getArray() != nullptr) arrays.insert(texture->getArray());
+    for (auto * array : arrays) TextureStreamer::instance()->makeResident(array);
+
+    const GLsizei size = Impostor::FRAMES * Impostor::FRAME_SIZE;
+    // frames stay apart down to 16 pixels, further levels would blend neighbouring frames
+    GLint levels = 1;
+    while ((Impostor::FRAME_SIZE >> levels) >= 16) levels++;
+
+    glGenTextures(1, &this->atlas);
+    TextureArrays::instance()->bindForUpdate(GL_TEXTURE_2D_ARRAY, this->atlas);
+    for (GLint level=0;level<levels;level++)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size >> level, size >> level, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLuint framebuffer = 0, depth = 0;
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->atlas, 0, 0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, this->atlas, 0, 1);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        const GLfloat noCoverage[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat noNormal[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+        glViewport(0, 0, size, size);
+        glClearBufferfv(GL_COLOR, 0, noCoverage);
+        glClearBufferfv(GL_COLOR, 1, noNormal);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        std::vector<InstanceTransform> instanceTransforms = { InstanceTransform() };
+        std::vector<GLushort> materialIndices = { 0 };
+        for (auto * mesh : meshes) {
+            mesh->setLodsEnabled(false);
+            mesh->setMaterialIndices(materialIndices);
+            mesh->setInstanceTransforms(instanceTransforms);
+        }
+
+        const glm::mat4 projection = glm::ortho(-this->radius, this->radius, -this->radius, this->radius, 0.0f, 2.0f * this->radius);
+        for (int y=0;y<Impostor::FRAMES;y++) {
+            for (int x=0;x<Impostor::FRAMES;x++) {
+                const glm::vec3 direction = Impostor::getFrameDirection(x, y);
+                const glm::vec3 up = glm::abs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                const glm::mat4 view = glm::lookAt(this->center + direction * this->radius, this->center, up);
+
+                glViewport(x * Impostor::FRAME_SIZE, y * Impostor::FRAME_SIZE, Impostor::FRAME_SIZE, Impostor::FRAME_SIZE);
+
+                for (auto * mesh : meshes) {
+                    // loading waits for the program, there is no later frame to bake in
+                    Shader * variant = mesh->selectShader(bakeShader);
+                    variant->finish();
+                    variant->use();
+                    if (!variant->isBeingUsed()) continue;
+
+                    variant->setMat4("view", view);
+                    variant->setMat4("projection", projection);
+                    mesh->render(variant);
+                    variant->stopUse();
+                }
+            }
+        }
+
+        for (auto * mesh : meshes) mesh->setLodsEnabled(true);
+
+        TextureArrays::instance()->bindForUpdate(GL_TEXTURE_2D_ARRAY, this->atlas);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    } else std::cerr << "Impostor framebuffer is incomplete" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depth);
+
+    if (!complete) {
+        this->cleanUp();
+        return false;
+    }
+
+    this->createVertexArray();
+
+    return true;
+}
+
+void Impostor::createVertexArray() {
+    const GLfloat corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+    glGenVertexArrays(1, &this->vertexArray);
+    glGenBuffers(1, &this->QUAD);
+    glGenBuffers(1, &this->INSTANCE_TRANSFORMS);
+    glGenBuffers(1, &this->MATERIALS);
+
+    glBindVertexArray(this->vertexArray);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->QUAD);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)offsetof(InstanceTransform, position));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_SHORT, GL_TRUE, sizeof(InstanceTransform), (void*)offsetof(InstanceTransform, rotation));
+    glEnableVertexAttribArray(7);
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)offsetof(InstanceTransform, scale));
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribDivisor(6, 1);
+    glVertexAttribDivisor(7, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
+    glEnableVertexAttribArray(9);
+    glVertexAttribIPointer(9, 1, GL_UNSIGNED_SHORT, sizeof(GLushort), (void*)0);
+    glVertexAttribDivisor(9, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Impostor::setInstances(std::vector<InstanceTransform> & instanceTransforms, std::vector<GLushort> & materialIndices) {
+    this->instanceTransforms = instanceTransforms;
+    this->materialIndices = materialIndices;
+}
+
+/*
+ * The quads write the depth of the baked surface, which they also need to when a depth pre-pass
+ * has disabled depth writes, as impostors are not part of it
+ */
+void Impostor::render(const bool depthPrePassed) {
+    if (this->atlas == 0 || this->shader == nullptr || this->instanceTransforms.empty()) return;
+
+    this->shader->use();
+    if (!this->shader->isBeingUsed()) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+    glBufferData(GL_ARRAY_BUFFER, this->instanceTransforms.size() * sizeof(InstanceTransform), this->instanceTransforms.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
+    glBufferData(GL_ARRAY_BUFFER, this->materialIndices.size() * sizeof(GLushort), this->materialIndices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    this->shader->setSceneUniforms();
+    this->shader->setVec3("impostorCenter", this->center);
+    this->shader->setFloat("impostorRadius", this->radius);
+    this->shader->setInt("impostorFrames", Impostor::FRAMES);
+    this->shader->setVec2("impostorFade", this->getFadeStart(), this->getFadeEnd());
+
+    glActiveTexture(GL_TEXTURE0 + Impostor::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->atlas);
+    this->shader->setInt("impostorAtlas", Impostor::TEXTURE_UNIT);
+
+    // the shading pass after a depth pre-pass has depth writes off
+    if (depthPrePassed) glDepthMask(GL_TRUE);
+
+    glBindVertexArray(this->vertexArray);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, this->instanceTransforms.size());
+    glBindVertexArray(0);
+
+    if (depthPrePassed) glDepthMask(GL_FALSE);
+
+    this->shader->stopUse();
+}
+
+void Impostor::cleanUp() {
+    if (this->atlas != 0) glDeleteTextures(1, &this->atlas);
+    this->atlas = 0;
+
+    if (this->vertexArray != 0) glDeleteVertexArrays(1, &this->vertexArray);
+    this->vertexArray = 0;
+
+    if (this->QUAD != 0) glDeleteBuffers(1, &this->QUAD);
+    if (this->INSTANCE_TRANSFORMS != 0) glDeleteBuffers(1, &this->INSTANCE_TRANSFORMS);
+    if (this->MATERIALS != 0) glDeleteBuffers(1, &this->MATERIALS);
+    this->QUAD = this->INSTANCE_TRANSFORMS = this->MATERIALS = 0;
+}
+
+Impostor::~Impostor() {
+    this->cleanUp();
+}
+
+constexpr float Impostor::DEFAULT_DISTANCE;
+constexpr float Impostor::FADE_RANGE;
@@ -9,6 +9,7 @@
     #include <iostream>
     #include <fstream>
     #include <ctype.h>
+    #include <climits>
     #include <memory>
     #include <vector>
     #include <set>
@@ -17,7 +18,12 @@
     #include <random>
     #include <thread>
     #include <mutex>
+    #include <condition_variable>
+    #include <functional>
+    #include <deque>
+    #include <algorithm>
     #include <atomic>
+    #include <tuple>
 
     #include <SDL.h>
     #include <SDL_image.h>
@@ -25,6 +31,8 @@
 
     #include <glm/glm.hpp>
     #include <glm/gtc/matrix_transform.hpp>
+    #include <glm/gtc/quaternion.hpp>
+    #include <glm/gtc/packing.hpp>
     #include <glm/gtc/type_ptr.hpp>
     #include <glm/gtx/string_cast.hpp>
 
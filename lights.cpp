@@ -0,0 +1,255 @@
+#include "render.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define LIGHT_CLUSTERS_SSE
+#endif
+
+LightClusters::LightClusters() {
+    this->minX.resize(LightClusters::CLUSTERS);
+    this->minY.resize(LightClusters::CLUSTERS);
+    this->minZ.resize(LightClusters::CLUSTERS);
+    this->maxX.resize(LightClusters::CLUSTERS);
+    this->maxY.resize(LightClusters::CLUSTERS);
+    this->maxZ.resize(LightClusters::CLUSTERS);
+    this->clusterLights.resize(LightClusters::CLUSTERS);
+}
+
+/*
+ * Slices grow exponentially with the distance, like the perspective does with the size of a pixel
+ */
+void LightClusters::updateBounds() {
+    // glm::perspective: [2][2] = -(f+n)/(f-n), [3][2] = -2fn/(f-n)
+    this->nearPlane = this->projection[3][2] / (this->projection[2][2] - 1.0f);
+    this->farPlane = this->projection[3][2] / (this->projection[2][2] + 1.0f);
+
+    const float ratio = this->farPlane / this->nearPlane;
+    for (GLint z=0;z<LightClusters::SLICES;z++) {
+        const float sliceNear = this->nearPlane * glm::pow(ratio, static_cast<float>(z) / LightClusters::SLICES);
+        const float sliceFar = this->nearPlane * glm::pow(ratio, static_cast<float>(z + 1) / LightClusters::SLICES);
+
+        for (GLint y=0;y<LightClusters::TILES_Y;y++) {
+            const float bottom = -1.0f + 2.0f * y / LightClusters::TILES_Y;
+            const float top = -1.0f + 2.0f * (y + 1) / LightClusters::TILES_Y;
+
+            for (GLint x=0;x<LightClusters::TILES_X;x++) {
+                const float left = -1.0f + 2.0f * x / LightClusters::TILES_X;
+                const float right = -1.0f + 2.0f * (x + 1) / LightClusters::TILES_X;
+                const GLint cluster = (z * LightClusters::TILES_Y + y) * LightClusters::TILES_X + x;
+
+                this->minX[cluster] = std::min(left * sliceNear, left * sliceFar) / this->projection[0][0];
+                this->maxX[cluster] = std::max(right * sliceNear, right * sliceFar) / this->projection[0][0];
+                this->minY[cluster] = std::min(bottom * sliceNear, bottom * sliceFar) / this->projection[1][1];
+                this->maxY[cluster] = std::max(top * sliceNear, top * sliceFar) / this->projection[1][1];
+                this->minZ[cluster] = -sliceFar;
+                this->maxZ[cluster] = -sliceNear;
+            }
+        }
+    }
+}
+
+GLint LightClusters::getSlice(const float depth) {
+    const float slice = glm::log(depth / this->nearPlane) / glm::log(this->farPlane / this->nearPlane) * LightClusters::SLICES;
+    return glm::clamp(static_cast<GLint>(slice), 0, LightClusters::SLICES - 1);
+}
+
+/*
+ * Narrows the clusters down to the screen rectangle and slices the bounding sphere can touch,
+ * then tests the sphere against the bounds of the clusters in there, 4 at a time
+ */
+void LightClusters::assign(const glm::vec3 & center, const float radius, const GLushort index) {
+    const float depth = -center.z;
+    if (radius <= 0.0f || depth + radius < this->nearPlane || depth - radius > this->farPlane) return;
+
+    const float minDepth = std::max(depth - radius, this->nearPlane);
+    const float maxDepth = std::min(depth + radius, this->farPlane);
+
+    const float left = std::min((center.x - radius) / minDepth, (center.x - radius) / maxDepth) * this->projection[0][0];
+    const float right = std::max((center.x + radius) / minDepth, (center.x + radius) / maxDepth) * this->projection[0][0];
+    const float bottom = std::min((center.y - radius) / minDepth, (center.y - radius) / maxDepth) * this->projection[1][1];
+    const float top = std::max((center.y + radius) / minDepth, (center.y + radius) / maxDepth) * this->projection[1][1];
+    if (right < -1.0f || left > 1.0f || top < -1.0f || bottom > 1.0f) return;
+
+    const GLint x0 = glm::clamp(static_cast<GLint>((left + 1.0f) * 0.5f * LightClusters::TILES_X), 0, LightClusters::TILES_X - 1);
+    const GLint x1 = glm::clamp(static_cast<GLint>((right + 1.0f) * 0.5f * LightClusters::TILES_X), 0, LightClusters::TILES_X - 1);
+    const GLint y0 = glm::clamp(static_cast<GLint>((bottom + 1.0f) * 0.5f * LightClusters::TILES_Y), 0, LightClusters::TILES_Y - 1);
+    const GLint y1 = glm::clamp(static_cast<GLint>((top + 1.0f) * 0.5f * LightClusters::TILES_Y), 0, LightClusters::TILES_Y - 1);
+    const GLint z0 = this->getSlice(minDepth);
+    const GLint z1 = this->getSlice(maxDepth);
+
+#ifdef LIGHT_CLUSTERS_SSE
+    const __m128 centerX = _mm_set1_ps(center.x);
+    const __m128 centerY = _mm_set1_ps(center.y);
+    const __m128 centerZ = _mm_set1_ps(center.z);
+    const __m128 radiusSquared = _mm_set1_ps(radius * radius);
+    const __m128 zero = _mm_setzero_ps();
+#endif
+
+    for (GLint z=z0;z<=z1;z++) {
+        for (GLint y=y0;y<=y1;y++) {
+            const GLint row = (z * LightClusters::TILES_Y + y) * LightClusters::TILES_X;
+
+#ifdef LIGHT_CLUSTERS_SSE
+            // rows are a multiple of 4 wide, clusters outside the range are masked off afterwards
+            for (GLint x=x0 & ~3;x<=x1;x+=4) {
+                const GLint cluster = row + x;
+
+                const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minX[cluster]), centerX),
+                    _mm_sub_ps(centerX, _mm_loadu_ps(&this->maxX[cluster]))), zero);
+                const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minY[cluster]), centerY),
+                    _mm_sub_ps(centerY, _mm_loadu_ps(&this->maxY[cluster]))), zero);
+                const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minZ[cluster]), centerZ),
+                    _mm_sub_ps(centerZ, _mm_loadu_ps(&this->maxZ[cluster]))), zero);
+                const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+                const int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+                for (GLint i=0;i<4;i++)
+                    if ((hits & (1 << i)) != 0 && x + i >= x0 && x + i <= x1) this->clusterLights[cluster + i].push_back(index);
+            }
+#else
+            for (GLint x=x0;x<=x1;x++) {
+                const GLint cluster = row + x;
+
+                const glm::vec3 min(this->minX[cluster], this->minY[cluster], this->minZ[cluster]);
+                const glm::vec3 max(this->maxX[cluster], this->maxY[cluster], this->maxZ[cluster]);
+                const glm::vec3 distance = glm::max(glm::max(min - center, center - max), glm::vec3(0.0f));
+
+                if (glm::dot(distance, distance) <= radius * radius) this->clusterLights[cluster].push_back(index);
+            }
+#endif
+        }
+    }
+}
+
+/*
+ * Called once per frame on the GL thread before anything lit is rendered
+ */
+void LightClusters::update() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] > 0 && viewport[3] > 0) this->viewportSize = glm::vec2(viewport[2], viewport[3]);
+
+    const glm::mat4 projection = Camera::instance()->getPerspective();
+    if (projection != this->projection) {
+        this->projection = projection;
+        this->updateBounds();
+    }
+
+    for (auto & lights : this->clusterLights) lights.clear();
+    this->lights.clear();
+    this->numberOfLights = 0;
+
+    const glm::mat4 view = Camera::instance()->getViewMatrix();
+
+    // spot lights are culled by the sphere around their full range, a point light has no cone
+    for (auto & light : World::instance()->getPointLights()) {
+        if (this->numberOfLights >= LightClusters::MAX_LIGHTS) break;
+
+        this->lights.push_back(glm::vec4(light.position, light.radius));
+        this->lights.push_back(glm::vec4(light.color, -2.0f));
+        this->lights.push_back(glm::vec4(0.0f, 0.0f, 0.0f, -2.0f));
+        this->assign(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.radius, this->numberOfLights++);
+    }
+
+    for (auto & light : World::instance()->getSpotLights()) {
+        if (this->numberOfLights >= LightClusters::MAX_LIGHTS) break;
+
+        this->lights.push_back(glm::vec4(light.position, light.radius));
+        this->lights.push_back(glm::vec4(light.color, glm::cos(light.innerAngle)));
+        this->lights.push_back(glm::vec4(glm::normalize(light.direction), glm::cos(light.outerAngle)));
+        this->assign(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.radius, this->numberOfLights++);
+    }
+
+    if (World::instance()->getPointLights().size() + World::instance()->getSpotLights().size() > LightClusters::MAX_LIGHTS) {
+        static bool warned = false;
+        if (!warned) std::cerr << "More than " << LightClusters::MAX_LIGHTS << " lights, the rest is ignored" << std::endl;
+        warned = true;
+    }
+
+    this->upload();
+}
+
+void LightClusters::upload() {
+    if (this->lightsBuffer == 0) {
+        glGenBuffers(1, &this->lightsBuffer);
+        glGenBuffers(1, &this->gridBuffer);
+        glGenBuffers(1, &this->indicesBuffer);
+        glGenTextures(1, &this->lightsTexture);
+        glGenTextures(1, &this->gridTexture);
+        glGenTextures(1, &this->indicesTexture);
+    }
+
+    // offset into the index list and number of lights per cluster
+    std::vector<glm::uvec2> grid;
+    std::vector<GLushort> indices;
+    grid.reserve(LightClusters::CLUSTERS);
+    for (auto & lights : this->clusterLights) {
+        grid.push_back(glm::uvec2(indices.size(), lights.size()));
+        indices.insert(indices.end(), lights.begin(), lights.end());
+    }
+
+    // buffer textures must not be empty
+    if (this->lights.empty()) this->lights.push_back(glm::vec4(0.0f));
+    if (indices.empty()) indices.push_back(0);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, this->lightsBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->lights.size() * sizeof(glm::vec4), &this->lights[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->gridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(glm::uvec2), &grid[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->indicesBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + LightClusters::LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->lightsBuffer);
+
+    glActiveTexture(GL_TEXTURE0 + LightClusters::GRID_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->gridTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, this->gridBuffer);
+
+    glActiveTexture(GL_TEXTURE0 + LightClusters::INDICES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->indicesTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, this->indicesBuffer);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::bind(Shader * shader) {
+    if (shader == nullptr) return;
+
+    if (this->lightsBuffer == 0) this->upload();
+
+    glActiveTexture(GL_TEXTURE0 + LightClusters::LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightsTexture);
+    glActiveTexture(GL_TEXTURE0 + LightClusters::GRID_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->gridTexture);
+    glActiveTexture(GL_TEXTURE0 + LightClusters::INDICES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->indicesTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader->setInt("lights", LightClusters::LIGHTS_UNIT);
+    shader->setInt("lightGrid", LightClusters::GRID_UNIT);
+    shader->setInt("lightIndices", LightClusters::INDICES_UNIT);
+
+    // the fragment's cluster: tile from its window position, slice from the log of its view depth
+    const float depthScale = LightClusters::SLICES / glm::log(this->farPlane / this->nearPlane);
+    shader->setVec2("clusterTileScale",
+        glm::vec2(LightClusters::TILES_X, LightClusters::TILES_Y) / this->viewportSize);
+    shader->setFloat("clusterDepthScale", depthScale);
+    shader->setFloat("clusterDepthBias", -glm::log(this->nearPlane) * depthScale);
+    shader->setIntVec("clusterCount", { LightClusters::TILES_X, LightClusters::TILES_Y, LightClusters::SLICES });
+}
+
+LightClusters::~LightClusters() {
+    if (this->lightsTexture != 0) glDeleteTextures(1, &this->lightsTexture);
+    if (this->gridTexture != 0) glDeleteTextures(1, &this->gridTexture);
+    if (this->indicesTexture != 0) glDeleteTextures(1, &this->indicesTexture);
+    if (this->lightsBuffer != 0) glDeleteBuffers(1, &this->lightsBuffer);
+    if (this->gridBuffer != 0) glDeleteBuffers(1, &this->gridBuffer);
+    if (this->indicesBuffer != 0) glDeleteBuffers(1, &this->indicesBuffer);
+
+    LightClusters::singleton = nullptr;
+}
+
+LightClusters * LightClusters::singleton = nullptr;
@@ -5,149 +5,376 @@ void Mesh::init() {
 
     glGenBuffers(1, &this->VBO);
     glGenBuffers(1, &this->EBO);
-    glGenBuffers(1, &this->MODEL_MATRIX);
+    glGenBuffers(1, &this->INSTANCE_TRANSFORMS);
     glGenBuffers(1, &this->MATERIALS);
+    glGenBuffers(1, &this->ANIMATIONS);
 
     glBindVertexArray(this->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(unsigned int), &this->indices[0], GL_STATIC_DRAW);
+    if (!this->vertices.empty()) {
+        glm::vec3 min = this->vertices[0].position;
+        glm::vec3 max = min;
+        for (auto & vertex : this->vertices) {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
+        this->center = (min + max) / 2.0f;
+        this->radius = glm::length(max - min) / 2.0f;
+    }
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    if (this->quantizePositions) this->uploadVertices<QuantizedVertex>();
+    else this->uploadVertices<PackedVertex>();
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    // the levels of detail index into the same vertices and follow the full detail indices
+    std::vector<unsigned int> allIndices(this->indices);
+    for (auto & lod : this->lods) {
+        lod.offset = allIndices.size();
+        allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+    }
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+    if (this->vertices.size() <= USHRT_MAX) {
+        const std::vector<GLushort> shortIndices(allIndices.begin(), allIndices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+        this->indexType = GL_UNSIGNED_SHORT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), &allIndices[0], GL_STATIC_DRAW);
+        this->indexType = GL_UNSIGNED_INT;
+    }
+    for (auto & lod : this->lods) lod.offset *= this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(unsigned int);
+
+    for (auto & texture : this->textures)
+        if (texture->isValid()) TextureArrays::instance()->add(texture);
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+    this->updateShaderDefines();
+}
 
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bitangent));
+void Mesh::updateShaderDefines() {
+    this->shaderDefines.clear();
+    this->translucent = this->opacity < 1.0f;
 
-    int i=0;
     for (auto & texture : this->textures) {
-        if (!texture->isValid()) continue;
+        if (!texture->isValid() || (texture->getType() == Model::TEXTURE_NORMALS && !this->useNormalsTexture)) continue;
+
+        std::string define = "HAS_" + texture->getType();
+        std::transform(define.begin(), define.end(), define.begin(), ::toupper);
+        this->shaderDefines.push_back(define);
+    }
+    if (this->impostorFade) this->shaderDefines.push_back("IMPOSTOR_FADE");
+    if (this->animation != nullptr) this->shaderDefines.push_back("HAS_VERTEX_ANIMATION");
+    if (this->translucent) this->shaderDefines.push_back("TRANSLUCENT");
 
-        SDL_Surface * textureSurface = texture->getTextureSurface();
+    this->variantBase = nullptr;
+    this->variant = nullptr;
+}
+
+/*
+ * The variant of the given program compiled for the textures of this mesh
+ */
+Shader * Mesh::selectShader(Shader * shader) {
+    if (shader != this->variantBase) {
+        this->variantBase = shader;
+        this->variant = ShaderRegistry::instance()->getVariant(shader, this->shaderDefines);
+    }
 
-        GLuint id = 0;
-        glGenTextures(1, &id);
-        // set global id
-        texture->setId(id);
+    return this->variant;
+}
 
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, texture->getId());
+GLint Mesh::getTextureUnit(const std::string & type) {
+    if (type == Model::AMBIENT_TEXTURE) return 0;
+    if (type == Model::DIFFUSE_TEXTURE) return 1;
+    if (type == Model::SPECULAR_TEXTURE) return 2;
+    if (type == Model::TEXTURE_NORMALS) return 3;
 
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    return 1;
+}
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, textureSurface->w, textureSurface->h, 0, texture->getImageFormat(),
-                GL_UNSIGNED_BYTE, textureSurface->pixels);
-        //glGenerateMipmap(GL_TEXTURE_2D);
-        i++;
+template <typename V>
+void Mesh::uploadVertices() {
+    if (this->quantizePositions && !this->vertices.empty()) {
+        glm::vec3 min = this->vertices[0].position;
+        glm::vec3 max = min;
+        for (auto & vertex : this->vertices) {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
+        this->bounds.min = min;
+        this->bounds.extent = glm::max(max - min, glm::vec3(std::numeric_limits<float>::epsilon()));
+    } else this->bounds = VertexBounds();
+
+    std::vector<V> packedVertices;
+    packedVertices.reserve(this->vertices.size());
+    for (auto & vertex : this->vertices) packedVertices.push_back(VertexLayout<V>::encode(vertex, this->bounds));
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(V), packedVertices.data(), GL_STATIC_DRAW);
+
+    for (auto & attribute : VertexLayout<V>::getAttributes()) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(V), (void*)attribute.offset);
     }
 }
 
-void Mesh::setModelMatrices(std::vector<glm::mat4> & modelMatrices) {
-    if (modelMatrices.size() == this->modelMatrices.size()) return;
+void Mesh::setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) {
+    this->instancesChanged = true;
 
-    this->modelMatrices = modelMatrices;
+    if (instanceTransforms.size() == this->instanceTransforms.size()) {
+        this->instanceTransforms = instanceTransforms;
+        return;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->MODEL_MATRIX);
-    glBufferData(GL_ARRAY_BUFFER, this->modelMatrices.size() * sizeof(glm::mat4), &this->modelMatrices[0], GL_DYNAMIC_DRAW);
+    this->instanceTransforms = instanceTransforms;
 
-    if (!this->modelMatricesEnabled) {
+    glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+    glBufferData(GL_ARRAY_BUFFER, this->instanceTransforms.size() * sizeof(InstanceTransform), this->instanceTransforms.data(), GL_DYNAMIC_DRAW);
+
+    if (!this->instanceTransformsEnabled) {
         glBindVertexArray(this->VAO);
 
         glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
         glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
         glEnableVertexAttribArray(7);
-        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-        glEnableVertexAttribArray(8);
-        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
 
         glVertexAttribDivisor(5, 1);
         glVertexAttribDivisor(6, 1);
         glVertexAttribDivisor(7, 1);
-        glVertexAttribDivisor(8, 1);
 
-        this->modelMatricesEnabled = true;
+        this->instanceTransformsEnabled = true;
+        this->pointInstanceAttributes(0);
         glBindVertexArray(0);
     }
 }
 
-void Mesh::setMaterials(std::vector<Material> & materials) {
-    if (materials.size() == this->materials.size()) return;
+void Mesh::setMaterialIndices(std::vector<GLushort> & materialIndices) {
+    this->instancesChanged = true;
+
+    if (materialIndices.size() == this->materialIndices.size()) {
+        this->materialIndices = materialIndices;
+        return;
+    }
 
-    this->materials = materials;
+    this->materialIndices = materialIndices;
 
     glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
-    glBufferData(GL_ARRAY_BUFFER, this->materials.size() * sizeof(Material), &this->materials[0], GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, this->materialIndices.size() * sizeof(GLushort), this->materialIndices.data(), GL_DYNAMIC_DRAW);
 
     if (!this->materialsEnabled) {
         glBindVertexArray(this->VAO);
 
+        // the material itself is looked up in the MaterialPalette texture buffer
         glEnableVertexAttribArray(9);
-        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(Material), (void*)offsetof(Material, emissiveColor));
+        glVertexAttribDivisor(9, 1);
 
-        glEnableVertexAttribArray(10);
-        glVertexAttribPointer(10, 4, GL_FLOAT, GL_FALSE, sizeof(Material), (void*)offsetof(Material, ambientColor));
+        this->materialsEnabled = true;
+        this->pointInstanceAttributes(0);
+        glBindVertexArray(0);
+    }
+}
 
-        glEnableVertexAttribArray(11);
-        glVertexAttribPointer(11, 4, GL_FLOAT, GL_FALSE, sizeof(Material), (void*)offsetof(Material, diffuseColor));
+void Mesh::setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations) {
+    this->instancesChanged = true;
 
-        glEnableVertexAttribArray(12);
-        glVertexAttribPointer(12, 4, GL_FLOAT, GL_FALSE, sizeof(Material), (void*)offsetof(Material, specularColor));
+    if (instanceAnimations.size() == this->instanceAnimations.size()) {
+        this->instanceAnimations = instanceAnimations;
+        return;
+    }
 
-        glEnableVertexAttribArray(13);
-        glVertexAttribPointer(13, 1, GL_FLOAT, GL_FALSE, sizeof(Material), (void*)offsetof(Material, shininess));
+    this->instanceAnimations = instanceAnimations;
 
-        glVertexAttribDivisor(9, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, this->ANIMATIONS);
+    glBufferData(GL_ARRAY_BUFFER, this->instanceAnimations.size() * sizeof(InstanceAnimation), this->instanceAnimations.data(), GL_DYNAMIC_DRAW);
+
+    if (!this->animationsEnabled) {
+        glBindVertexArray(this->VAO);
+
+        // the frames themselves are looked up in the VertexAnimation texture buffer
+        glEnableVertexAttribArray(10);
+        glEnableVertexAttribArray(11);
         glVertexAttribDivisor(10, 1);
         glVertexAttribDivisor(11, 1);
-        glVertexAttribDivisor(12, 1);
-        glVertexAttribDivisor(13, 1);
 
-        this->materialsEnabled = true;
+        this->animationsEnabled = true;
+        this->pointInstanceAttributes(0);
         glBindVertexArray(0);
     }
 }
 
-void Mesh::render(Shader * shader) {
-    glBindVertexArray(this->VAO);
+/*
+ * Instanced draws have no base instance in GL 3.3, so the instance attributes of the bound VAO
+ * are pointed at the first instance of a draw instead
+ */
+void Mesh::pointInstanceAttributes(const size_t firstInstance) {
+    if (this->instanceTransformsEnabled) {
+        const size_t offset = firstInstance * sizeof(InstanceTransform);
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offset + offsetof(InstanceTransform, position)));
+        glVertexAttribPointer(6, 4, GL_SHORT, GL_TRUE, sizeof(InstanceTransform), (void*)(offset + offsetof(InstanceTransform, rotation)));
+        glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offset + offsetof(InstanceTransform, scale)));
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->MODEL_MATRIX);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, this->modelMatrices.size() * sizeof(glm::mat4), &this->modelMatrices[0]);
+    if (this->materialsEnabled) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
+        glVertexAttribIPointer(9, 1, GL_UNSIGNED_SHORT, sizeof(GLushort), (void*)(firstInstance * sizeof(GLushort)));
+    }
+
+    if (this->animationsEnabled) {
+        const size_t offset = firstInstance * sizeof(InstanceAnimation);
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->ANIMATIONS);
+        glVertexAttribIPointer(10, 1, GL_UNSIGNED_SHORT, sizeof(InstanceAnimation), (void*)(offset + offsetof(InstanceAnimation, clip)));
+        glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceAnimation), (void*)(offset + offsetof(InstanceAnimation, timeOffset)));
+    }
+}
+
+unsigned int Mesh::getLod(const float projectedSize) {
+    if (projectedSize >= Mesh::LOD_SCREEN_SIZE) return 0;
+
+    const float level = 1.0f + glm::floor(glm::log2(Mesh::LOD_SCREEN_SIZE / std::max(projectedSize, 1.0f)));
+    return static_cast<unsigned int>(std::min(level, static_cast<float>(this->lods.size())));
+}
+
+/*
+ * Picks the level of every instance from its projected size, an instance only changes level once its size
+ * is past the threshold by the hysteresis, then uploads the instances sorted by level so that each level is one range
+ */
+void Mesh::updateInstances() {
+    this->instancesChanged = false;
+    this->lodInstanceCounts.assign(this->lods.size() + 1, 0);
+
+    const size_t numberOfInstances = this->instanceTransforms.size();
+    if (this->lods.empty() || !this->lodsEnabled || numberOfInstances == 0) {
+        this->lodInstanceCounts[0] = numberOfInstances;
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, numberOfInstances * sizeof(InstanceTransform), this->instanceTransforms.data());
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, this->materialIndices.size() * sizeof(GLushort), this->materialIndices.data());
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->ANIMATIONS);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, this->instanceAnimations.size() * sizeof(InstanceAnimation), this->instanceAnimations.data());
+        return;
+    }
+
+    const glm::vec3 eye = Camera::instance()->getPosition();
+    const float focalLength = Camera::instance()->getPerspective()[1][1] * TextureStreamer::instance()->getViewportHeight() / 2.0f;
+
+    if (this->instanceLods.size() != numberOfInstances) this->instanceLods.assign(numberOfInstances, 0);
+    for (size_t i=0;i<numberOfInstances;i++) {
+        const float projectedSize = this->calculateProjectedSize(this->instanceTransforms[i], eye, focalLength);
+        const unsigned int coarser = this->getLod(projectedSize * (1.0f + Mesh::LOD_HYSTERESIS));
+        const unsigned int finer = this->getLod(projectedSize * (1.0f - Mesh::LOD_HYSTERESIS));
+
+        unsigned int & lod = this->instanceLods[i];
+        if (lod < coarser) lod = coarser;
+        else if (lod > finer) lod = finer;
+
+        this->lodInstanceCounts[lod]++;
+    }
+
+    std::vector<size_t> firstInstances(this->lodInstanceCounts.size(), 0);
+    for (size_t level=1;level<firstInstances.size();level++)
+        firstInstances[level] = firstInstances[level - 1] + this->lodInstanceCounts[level - 1];
+
+    const bool sortMaterials = this->materialIndices.size() == numberOfInstances;
+    const bool sortAnimations = this->instanceAnimations.size() == numberOfInstances;
+    std::vector<InstanceTransform> sortedTransforms(numberOfInstances);
+    std::vector<GLushort> sortedMaterials(this->materialIndices);
+    std::vector<InstanceAnimation> sortedAnimations(this->instanceAnimations);
+    for (size_t i=0;i<numberOfInstances;i++) {
+        const size_t sorted = firstInstances[this->instanceLods[i]]++;
+        sortedTransforms[sorted] = this->instanceTransforms[i];
+        if (sortMaterials) sortedMaterials[sorted] = this->materialIndices[i];
+        if (sortAnimations) sortedAnimations[sorted] = this->instanceAnimations[i];
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->INSTANCE_TRANSFORMS);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, numberOfInstances * sizeof(InstanceTransform), sortedTransforms.data());
 
     glBindBuffer(GL_ARRAY_BUFFER, this->MATERIALS);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, this->materials.size() * sizeof(Material), &this->materials[0]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sortedMaterials.size() * sizeof(GLushort), sortedMaterials.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->ANIMATIONS);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sortedAnimations.size() * sizeof(InstanceAnimation), sortedAnimations.data());
+}
+
+void Mesh::render(Shader * shader, const bool withTextures) {
+    glBindVertexArray(this->VAO);
+
+    // depth and shading passes of a frame draw the same selection
+    if (this->instancesChanged) this->updateInstances();
 
     if (shader != nullptr && shader->isBeingUsed()) {
-        int i=0;
+        shader->setVec3("positionOffset", this->bounds.min);
+        shader->setVec3("positionScale", this->bounds.extent);
+
+        // the depth program is shared by all meshes and switches on a uniform, the shading variants on a define
+        shader->setBool("vertexAnimation", this->animation != nullptr);
+        if (this->animation != nullptr) this->animation->bind(shader);
+    }
+
+    if (shader != nullptr && shader->isBeingUsed() && withTextures) {
+        const float projectedSize = this->calculateProjectedSize();
+
+        std::vector<GLint> layers(4, 0);
         for (auto & texture : this->textures) {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, texture->getId());
+            if (texture->getArray() == nullptr) continue;
+
+            TextureStreamer::instance()->request(texture.get(), projectedSize);
+
+            const GLint unit = Mesh::getTextureUnit(texture->getType());
+            TextureArrays::instance()->bind(unit, texture->getArray());
+            layers[unit] = texture->getLayer();
 
-            shader->setInt(texture->getType(), i);
-            shader->setInt("has_" + texture->getType(),
-                    texture->getType() == Model::TEXTURE_NORMALS && !this->useNormalsTexture ? 0 : 1);
-            i++;
+            shader->setInt(texture->getType(), unit);
         }
+        shader->setIntVec("texture_layers", layers);
+        if (this->translucent) shader->setFloat("opacity", this->opacity);
     }
 
-    glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, this->modelMatrices.size());
+    if (this->lods.empty()) glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), this->indexType, 0, this->instanceTransforms.size());
+    else {
+        size_t firstInstance = 0;
+        for (size_t level=0;level<this->lodInstanceCounts.size();level++) {
+            const GLsizei count = this->lodInstanceCounts[level];
+            if (count == 0) continue;
+
+            this->pointInstanceAttributes(firstInstance);
+            if (level == 0) glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), this->indexType, 0, count);
+            else {
+                const MeshLod & lod = this->lods[level - 1];
+                glDrawElementsInstanced(GL_TRIANGLES, lod.indices.size(), this->indexType, (void*)lod.offset, count);
+            }
+
+            firstInstance += count;
+        }
+    }
 
     glBindVertexArray(0);
 }
 
+/*
+ * Largest on screen diameter in pixels of the bounding spheres of all instances
+ */
+float Mesh::calculateProjectedSize() {
+    const glm::vec3 eye = Camera::instance()->getPosition();
+    const float focalLength = Camera::instance()->getPerspective()[1][1] * TextureStreamer::instance()->getViewportHeight() / 2.0f;
+
+    float projectedSize = 0.0f;
+    for (auto & instanceTransform : this->instanceTransforms)
+        projectedSize = std::max(projectedSize, this->calculateProjectedSize(instanceTransform, eye, focalLength));
+
+    return projectedSize;
+}
+
+float Mesh::calculateProjectedSize(const InstanceTransform & instanceTransform, const glm::vec3 & eye, const float focalLength) {
+    const float instanceRadius = (this->radius + glm::length(this->center)) * instanceTransform.scale;
+    const float distance = std::max(glm::distance(instanceTransform.position, eye) - instanceRadius, 0.1f);
+
+    return 2.0f * instanceRadius * focalLength / distance;
+}
+
 void Mesh::cleanUp() {
     for (int i=0;i<14;i++) glDisableVertexAttribArray(i);
 
@@ -156,8 +383,12 @@ void Mesh::cleanUp() {
     glDeleteBuffers(1, &this->VBO);
     glDeleteBuffers(1, &this->EBO);
 
-    glDeleteBuffers(1, &this->MODEL_MATRIX);
+    glDeleteBuffers(1, &this->INSTANCE_TRANSFORMS);
     glDeleteBuffers(1, &this->MATERIALS);
+    glDeleteBuffers(1, &this->ANIMATIONS);
 
-    for (auto texture : this->textures) texture->cleanUp();
+    if (this->animation != nullptr) this->animation->cleanUp();
 }
+
+constexpr float Mesh::LOD_SCREEN_SIZE;
+constexpr float Mesh::LOD_HYSTERESIS;
@@ -35,6 +35,7 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
      std::vector<Vertex> vertices;
      std::vector<unsigned int> indices;
      std::vector<std::shared_ptr<Texture>> textures;
+     float opacity = 1.0f;
 
      if (scene->HasMaterials()) {
          const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -48,6 +49,7 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
          aiGetMaterialColor(material, AI_MATKEY_COLOR_AMBIENT, ambient.get());
          aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, diffuse.get());
          aiGetMaterialColor(material, AI_MATKEY_COLOR_SPECULAR, specular.get());
+         aiGetMaterialFloat(material, AI_MATKEY_OPACITY, &opacity);
 
          this->addTextures(material, aiTextureType_AMBIENT, Model::AMBIENT_TEXTURE, textures);
          this->addTextures(material, aiTextureType_DIFFUSE, Model::DIFFUSE_TEXTURE, textures);
@@ -89,7 +91,145 @@ Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
          for(unsigned int j = 0; j < face.mNumIndices; j++) indices.push_back(face.mIndices[j]);
      }
 
-     return Mesh(vertices, indices, textures);
+     // skinning works on the imported order, the optimizer's remap sorts the baked frames afterwards
+     std::vector<Vertex> skinnedVertices;
+     if (mesh->HasBones() && scene->HasAnimations()) skinnedVertices = vertices;
+
+     const std::string name = this->file + ":" + mesh->mName.C_Str();
+     std::vector<unsigned int> remap;
+     MeshOptimizer::optimize(vertices, indices, name, remap);
+
+     Mesh result(vertices, indices, textures);
+     result.setOpacity(opacity);
+     result.setLods(MeshSimplifier::generateLods(vertices, indices, name));
+     if (!skinnedVertices.empty())
+        result.setAnimation(this->bakeAnimations(mesh, scene, skinnedVertices, remap, vertices.size()));
+
+     return result;
+}
+
+static aiVector3D interpolateKeys(const aiVectorKey * keys, const unsigned int numberOfKeys, const double tick) {
+    if (numberOfKeys == 1 || tick <= keys[0].mTime) return keys[0].mValue;
+
+    for (unsigned int i=0;i+1<numberOfKeys;i++) {
+        if (tick >= keys[i + 1].mTime) continue;
+
+        const float blend = static_cast<float>((tick - keys[i].mTime) / (keys[i + 1].mTime - keys[i].mTime));
+        return keys[i].mValue + (keys[i + 1].mValue - keys[i].mValue) * blend;
+    }
+
+    return keys[numberOfKeys - 1].mValue;
+}
+
+static aiQuaternion interpolateKeys(const aiQuatKey * keys, const unsigned int numberOfKeys, const double tick) {
+    if (numberOfKeys == 1 || tick <= keys[0].mTime) return keys[0].mValue;
+
+    for (unsigned int i=0;i+1<numberOfKeys;i++) {
+        if (tick >= keys[i + 1].mTime) continue;
+
+        aiQuaternion rotation;
+        const float blend = static_cast<float>((tick - keys[i].mTime) / (keys[i + 1].mTime - keys[i].mTime));
+        aiQuaternion::Interpolate(rotation, keys[i].mValue, keys[i + 1].mValue, blend);
+        return rotation.Normalize();
+    }
+
+    return keys[numberOfKeys - 1].mValue;
+}
+
+// the global transform of every node at the tick, animated nodes replace their bind pose
+static void collectNodeTransforms(const aiNode * node, const aiMatrix4x4 & parent, const aiAnimation * animation,
+        const double tick, std::map<std::string, aiMatrix4x4> & transforms) {
+    aiMatrix4x4 transform = node->mTransformation;
+
+    for (unsigned int i=0;i<animation->mNumChannels;i++) {
+        const aiNodeAnim * channel = animation->mChannels[i];
+        if (channel->mNodeName != node->mName) continue;
+        if (channel->mNumPositionKeys == 0 || channel->mNumRotationKeys == 0 || channel->mNumScalingKeys == 0) break;
+
+        transform = aiMatrix4x4(
+            interpolateKeys(channel->mScalingKeys, channel->mNumScalingKeys, tick),
+            interpolateKeys(channel->mRotationKeys, channel->mNumRotationKeys, tick),
+            interpolateKeys(channel->mPositionKeys, channel->mNumPositionKeys, tick));
+        break;
+    }
+
+    const aiMatrix4x4 global = parent * transform;
+    transforms[node->mName.C_Str()] = global;
+
+    for (unsigned int i=0;i<node->mNumChildren;i++)
+        collectNodeTransforms(node->mChildren[i], global, animation, tick, transforms);
+}
+
+/*
+ * Skins the mesh on the cpu for every animation of the scene, sampled at the bake rate,
+ * and stores the frames in the optimized vertex order for playback in the vertex shader
+ */
+std::shared_ptr<VertexAnimation> Model::bakeAnimations(const aiMesh * mesh, const aiScene * scene,
+        const std::vector<Vertex> & vertices, const std::vector<unsigned int> & remap, const size_t numberOfVertices) {
+    std::vector<std::vector<std::pair<unsigned int, float>>> weights(vertices.size());
+    for (unsigned int b=0;b<mesh->mNumBones;b++) {
+        const aiBone * bone = mesh->mBones[b];
+        for (unsigned int w=0;w<bone->mNumWeights;w++) {
+            const aiVertexWeight & weight = bone->mWeights[w];
+            if (weight.mVertexId < weights.size()) weights[weight.mVertexId].push_back(std::make_pair(b, weight.mWeight));
+        }
+    }
+
+    aiMatrix4x4 globalInverse = scene->mRootNode->mTransformation;
+    globalInverse.Inverse();
+
+    std::shared_ptr<VertexAnimation> animation(new VertexAnimation(numberOfVertices));
+    for (unsigned int a=0;a<scene->mNumAnimations;a++) {
+        if (animation->getNumberOfClips() >= static_cast<size_t>(VertexAnimation::MAX_CLIPS)) break;
+
+        const aiAnimation * clip = scene->mAnimations[a];
+        const double ticksPerSecond = clip->mTicksPerSecond > 0.0 ? clip->mTicksPerSecond : 25.0;
+        const size_t numberOfFrames =
+            std::max(static_cast<size_t>(glm::ceil(clip->mDuration / ticksPerSecond * VertexAnimation::BAKE_RATE)), static_cast<size_t>(1));
+
+        std::vector<std::vector<Vertex>> frames(numberOfFrames, std::vector<Vertex>(numberOfVertices, Vertex(glm::vec3(0.0f))));
+        for (size_t f=0;f<numberOfFrames;f++) {
+            std::map<std::string, aiMatrix4x4> nodeTransforms;
+            collectNodeTransforms(scene->mRootNode, aiMatrix4x4(), clip, f / VertexAnimation::BAKE_RATE * ticksPerSecond, nodeTransforms);
+
+            std::vector<glm::mat4> bones(mesh->mNumBones);
+            for (unsigned int b=0;b<mesh->mNumBones;b++) {
+                const auto node = nodeTransforms.find(mesh->mBones[b]->mName.C_Str());
+                const aiMatrix4x4 bone = globalInverse * (node != nodeTransforms.end() ? node->second : aiMatrix4x4()) * mesh->mBones[b]->mOffsetMatrix;
+                // assimp matrices are row major
+                bones[b] = glm::transpose(glm::make_mat4(&bone.a1));
+            }
+
+            for (size_t v=0;v<vertices.size();v++) {
+                if (remap[v] >= numberOfVertices) continue;
+
+                Vertex vertex = vertices[v];
+                glm::mat4 skin(0.0f);
+                float totalWeight = 0.0f;
+                for (auto & weight : weights[v]) {
+                    skin += bones[weight.first] * weight.second;
+                    totalWeight += weight.second;
+                }
+
+                // vertices no bone moves keep their bind pose
+                if (totalWeight > 0.0f) {
+                    skin /= totalWeight;
+                    vertex.position = glm::vec3(skin * glm::vec4(vertex.position, 1.0f));
+                    vertex.normal = glm::normalize(glm::mat3(skin) * vertex.normal);
+                }
+
+                frames[f][remap[v]] = vertex;
+            }
+        }
+
+        animation->addClip(frames);
+    }
+
+    if (animation->getNumberOfClips() == 0) return nullptr;
+
+    std::cout << "Baked " << animation->getNumberOfClips() << " animations for " << this->file << ":" << mesh->mName.C_Str() << std::endl;
+
+    return animation;
 }
 
 void Model::correctTexturePath(char * path) {
@@ -116,20 +256,8 @@ void Model::addTextures(const aiMaterial * mat, const aiTextureType type, const
 
         const std::string fullyQualifiedName(this->dir + "/res/models/" + std::string(str.C_Str(), str.length));
 
-        std::map<std::string, std::shared_ptr<Texture>>::iterator val(Game::TEXTURES.find(fullyQualifiedName));
-
-        if (val != Game::TEXTURES.end()) textures.push_back(val->second);
-        else {
-            std::shared_ptr<Texture> texture(new Texture());
-            texture->setType(name);
-            texture->setPath(fullyQualifiedName);
-            texture->load();
-
-            if (texture->isValid()) {
-                textures.push_back(texture);
-                Game::TEXTURES[str.C_Str()] = std::move(texture);
-            } else texture.reset();
-        }
+        std::shared_ptr<Texture> texture = TextureRegistry::instance()->getTexture(fullyQualifiedName, name);
+        if (texture != nullptr) textures.push_back(texture);
     }
 }
 
@@ -141,31 +269,119 @@ void Model::init() {
     this->initialized = true;
 }
 
-void Model::render(Shader * shader) {
+void Model::render(Shader * shader, const bool translucent, const bool depthPrePassed) {
     if (!this->initialized || shader == nullptr) return;
 
-    if (shader->isBeingUsed()) {
-        shader->setMat4("view", Camera::instance()->getViewMatrix());
-        shader->setMat4("projection", Camera::instance()->getPerspective());
-        shader->setVec3("ambientLight",  World::instance()->getAmbientLight());
-        shader->setVec3("sunDirection", World::instance()->getSunDirection());
-        shader->setVec3("sunLightColor", World::instance()->getSunLightColor());
-        shader->setVec3("eyePosition", Camera::instance()->getPosition());
+    // after a depth pre-pass the meshes stay whole, the impostors dither in behind them.
+    // Translucent meshes never write depth and always dither
+    const glm::vec2 impostorFade = this->impostor != nullptr && (!depthPrePassed || translucent) ?
+        glm::vec2(this->impostor->getFadeStart(), this->impostor->getFadeEnd()) : glm::vec2(0.0f);
+
+    // meshes draw with the variant compiled for their textures, consecutive ones often share it
+    Shader * active = nullptr;
+    for (auto & mesh : this->meshes) {
+        if (mesh.isTranslucent(shader) != translucent) continue;
+
+        Shader * variant = mesh.selectShader(shader);
+        if (variant != active) {
+            if (active != nullptr) active->stopUse();
+            variant->use();
+            if (variant->isBeingUsed()) {
+                variant->setSceneUniforms();
+                if (this->impostor != nullptr) variant->setVec2("impostorFade", impostorFade);
+            }
+            active = variant;
+        }
+
+        if (variant->isBeingUsed()) mesh.render(variant);
+    }
+
+    if (active != nullptr) active->stopUse();
+
+    if (this->impostor != nullptr && !translucent) this->impostor->render(depthPrePassed);
+}
+
+/*
+ * Bakes the impostor that instances beyond the distance are drawn with instead of the meshes
+ */
+void Model::createImpostor(const float distance) {
+    if (!this->initialized || this->impostor != nullptr) return;
 
-        for (auto & mesh : this->meshes) mesh.render(shader);
+    Impostor * impostor = new Impostor(ShaderRegistry::instance()->getShader(this->dir + "/res/shaders/impostor"), distance);
+    if (!impostor->bake(this->getMeshes(), ShaderRegistry::instance()->getShader(this->dir + "/res/shaders/impostor_bake"))) {
+        delete impostor;
+        return;
     }
+
+    this->impostor = impostor;
+    for (auto & mesh : this->meshes) mesh.setImpostorFade(true);
 }
 
-void Model::setMaterials(std::vector<Material> & materials) {
-    for (auto & mesh : this->meshes) mesh.setMaterials(materials);
+void Model::setMaterialIndices(std::vector<GLushort> & materialIndices) {
+    if (this->impostor != nullptr) {
+        this->materialIndices = materialIndices;
+        return;
+    }
+
+    for (auto & mesh : this->meshes) mesh.setMaterialIndices(materialIndices);
 }
 
-void Model::setModelMatrices(std::vector<glm::mat4> & modelMatrices) {
-    for (auto & mesh : this->meshes) mesh.setModelMatrices(modelMatrices);
+void Model::setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations) {
+    if (this->impostor != nullptr) {
+        this->instanceAnimations = instanceAnimations;
+        return;
+    }
+
+    for (auto & mesh : this->meshes) mesh.setInstanceAnimations(instanceAnimations);
 }
 
+/*
+ * With an impostor, instances closer than the end of the cross fade go to the meshes and
+ * instances beyond its start to the impostor, the ones in between are drawn by both
+ */
+void Model::setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) {
+    if (this->impostor == nullptr) {
+        for (auto & mesh : this->meshes) mesh.setInstanceTransforms(instanceTransforms);
+        return;
+    }
+
+    const glm::vec3 eye = Camera::instance()->getPosition();
+    const float fadeStart = this->impostor->getFadeStart();
+    const float fadeEnd = this->impostor->getFadeEnd();
+    const bool hasMaterials = this->materialIndices.size() == instanceTransforms.size();
+    const bool hasAnimations = this->instanceAnimations.size() == instanceTransforms.size();
+
+    std::vector<InstanceTransform> meshTransforms, impostorTransforms;
+    std::vector<GLushort> meshMaterials, impostorMaterials;
+    std::vector<InstanceAnimation> meshAnimations;
+    for (size_t i=0;i<instanceTransforms.size();i++) {
+        const float distance = glm::distance(instanceTransforms[i].position, eye);
+        const GLushort materialIndex = hasMaterials ? this->materialIndices[i] : 0;
+
+        if (distance < fadeEnd) {
+            meshTransforms.push_back(instanceTransforms[i]);
+            meshMaterials.push_back(materialIndex);
+            // impostors are baked from the bind pose
+            if (hasAnimations) meshAnimations.push_back(this->instanceAnimations[i]);
+        }
+        if (distance > fadeStart) {
+            impostorTransforms.push_back(instanceTransforms[i]);
+            impostorMaterials.push_back(materialIndex);
+        }
+    }
+
+    for (auto & mesh : this->meshes) {
+        mesh.setMaterialIndices(meshMaterials);
+        if (hasAnimations) mesh.setInstanceAnimations(meshAnimations);
+        mesh.setInstanceTransforms(meshTransforms);
+    }
+    this->impostor->setInstances(impostorTransforms, impostorMaterials);
+}
 
 void Model::cleanUp() {
+    if (this->impostor != nullptr) delete this->impostor;
+    this->impostor = nullptr;
+
     if (!this->initialized) return;
 
     for (auto & mesh : this->meshes) mesh.cleanUp();
@@ -174,10 +390,21 @@ void Model::cleanUp() {
     this->loaded = false;
 }
 
+std::vector<Mesh *> Model::getMeshes() {
+    std::vector<Mesh *> meshes;
+    for (auto & mesh : this->meshes) meshes.push_back(&mesh);
+
+    return meshes;
+}
+
 void Model::useNormalsTexture(const bool flag) {
     for (auto & mesh : this->meshes) mesh.setUseNormalsTexture(flag);
 }
 
+void Model::setOpacity(const float opacity) {
+    for (auto & mesh : this->meshes) mesh.setOpacity(opacity);
+}
+
 const std::string Model::AMBIENT_TEXTURE = "texture_ambient";
 const std::string Model::DIFFUSE_TEXTURE = "texture_diffuse";
 const std::string Model::SPECULAR_TEXTURE = "texture_specular";
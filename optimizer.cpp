@@ -0,0 +1,220 @@
+#include "render.hpp"
+
+/*
+ * FIFO post transform cache simulation returning the cache misses
+ */
+static unsigned int simulateVertexCache(const std::vector<unsigned int> & indices, const unsigned int cacheSize) {
+    std::vector<unsigned int> cache(cacheSize, UINT_MAX);
+    std::set<unsigned int> cached;
+    unsigned int next = 0;
+    unsigned int misses = 0;
+
+    for (auto index : indices) {
+        if (cached.find(index) != cached.end()) continue;
+
+        if (cache[next] != UINT_MAX) cached.erase(cache[next]);
+        cache[next] = index;
+        cached.insert(index);
+        next = (next + 1) % cacheSize;
+        misses++;
+    }
+
+    return misses;
+}
+
+MeshOptimizerStatistics MeshOptimizer::analyze(const std::vector<unsigned int> & indices, const size_t numberOfVertices) {
+    MeshOptimizerStatistics stats;
+    if (indices.empty() || numberOfVertices == 0) return stats;
+
+    const unsigned int misses = simulateVertexCache(indices, MeshOptimizer::CACHE_SIZE);
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(numberOfVertices);
+
+    return stats;
+}
+
+/*
+ * Tipsify (Sander, Nehab, Barczak 2007): greedy fanning around cached vertices.
+ * The positions in the output at which it had to jump to a dead end vertex are returned as cluster starts.
+ */
+std::vector<unsigned int> MeshOptimizer::optimizeVertexCache(
+        std::vector<unsigned int> & indices, const size_t numberOfVertices, std::vector<size_t> & clusters) {
+    const size_t numberOfTriangles = indices.size() / 3;
+    const int cacheSize = static_cast<int>(MeshOptimizer::CACHE_SIZE);
+
+    std::vector<std::vector<unsigned int>> adjacency(numberOfVertices);
+    std::vector<int> liveTriangles(numberOfVertices, 0);
+    for (size_t t=0;t<numberOfTriangles;t++) {
+        for (int j=0;j<3;j++) {
+            adjacency[indices[t * 3 + j]].push_back(t);
+            liveTriangles[indices[t * 3 + j]]++;
+        }
+    }
+
+    std::vector<int> cacheTime(numberOfVertices, 0);
+    std::vector<bool> emitted(numberOfTriangles, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    int timeStamp = cacheSize + 1;
+    size_t cursor = 0;
+    long fanningVertex = 0;
+
+    clusters.clear();
+    clusters.push_back(0);
+
+    while (fanningVertex >= 0) {
+        std::vector<unsigned int> candidates;
+
+        for (auto t : adjacency[fanningVertex]) {
+            if (emitted[t]) continue;
+
+            for (int j=0;j<3;j++) {
+                const unsigned int v = indices[t * 3 + j];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (timeStamp - cacheTime[v] > cacheSize) cacheTime[v] = timeStamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // prefer the candidate that stays in cache the longest while still having live triangles
+        fanningVertex = -1;
+        int bestPriority = -1;
+        for (auto v : candidates) {
+            if (liveTriangles[v] <= 0) continue;
+
+            int priority = 0;
+            if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) priority = timeStamp - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanningVertex = v;
+            }
+        }
+
+        if (fanningVertex >= 0) continue;
+
+        while (!deadEnds.empty() && fanningVertex < 0) {
+            const unsigned int d = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[d] > 0) fanningVertex = d;
+        }
+
+        while (fanningVertex < 0 && cursor < numberOfVertices) {
+            if (liveTriangles[cursor] > 0) fanningVertex = cursor;
+            else cursor++;
+        }
+
+        if (fanningVertex >= 0 && output.size() > clusters.back()) clusters.push_back(output.size());
+    }
+
+    return output;
+}
+
+/*
+ * Orders the clusters so that the ones facing outwards from the mesh center,
+ * which are likely to occlude the rest, are drawn first.
+ */
+void MeshOptimizer::optimizeOverdraw(
+        std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices, const std::vector<size_t> & clusters) {
+    if (clusters.size() < 2) return;
+
+    glm::vec3 meshCenter(0.0f);
+    for (auto & vertex : vertices) meshCenter += vertex.position;
+    meshCenter /= static_cast<float>(vertices.size());
+
+    std::vector<std::pair<float, size_t>> sortKeys;
+    for (size_t c=0;c<clusters.size();c++) {
+        const size_t start = clusters[c];
+        const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t i=start;i<end;i+=3) {
+            const glm::vec3 & a = vertices[indices[i]].position;
+            const glm::vec3 & b = vertices[indices[i + 1]].position;
+            const glm::vec3 & e = vertices[indices[i + 2]].position;
+            const glm::vec3 faceNormal = glm::cross(b - a, e - a);
+            const float faceArea = glm::length(faceNormal);
+
+            center += (a + b + e) / 3.0f * faceArea;
+            normal += faceNormal;
+            area += faceArea;
+        }
+        if (area > 0.0f) center /= area;
+
+        const float normalLength = glm::length(normal);
+        const float occlusion = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+        sortKeys.push_back(std::make_pair(-occlusion, c));
+    }
+
+    std::stable_sort(sortKeys.begin(), sortKeys.end());
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (auto & key : sortKeys) {
+        const size_t start = clusters[key.second];
+        const size_t end = key.second + 1 < clusters.size() ? clusters[key.second + 1] : indices.size();
+        sorted.insert(sorted.end(), indices.begin() + start, indices.begin() + end);
+    }
+
+    indices = sorted;
+}
+
+/*
+ * Renumbers vertices in the order they are first referenced, dropping unused ones
+ */
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices) {
+    std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto & index : indices) {
+        if (remap[index] == UINT_MAX) {
+            remap[index] = reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices = reordered;
+
+    return remap;
+}
+
+void MeshOptimizer::optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::string & name) {
+    std::vector<unsigned int> remap;
+    MeshOptimizer::optimize(vertices, indices, name, remap);
+}
+
+void MeshOptimizer::optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::string & name,
+        std::vector<unsigned int> & remap) {
+    remap.resize(vertices.size());
+    for (size_t i=0;i<remap.size();i++) remap[i] = i;
+
+    if (vertices.empty() || indices.size() < 3 || indices.size() % 3 != 0) return;
+
+    const MeshOptimizerStatistics before = MeshOptimizer::analyze(indices, vertices.size());
+
+    std::vector<size_t> clusters;
+    indices = MeshOptimizer::optimizeVertexCache(indices, vertices.size(), clusters);
+    MeshOptimizer::optimizeOverdraw(indices, vertices, clusters);
+    remap = MeshOptimizer::optimizeVertexFetch(vertices, indices);
+
+    const MeshOptimizerStatistics after = MeshOptimizer::analyze(indices, vertices.size());
+
+    std::cout << "Optimized " << name << " (" << vertices.size() << " vertices, " << indices.size() / 3 << " triangles): " <<
+            "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+void MeshOptimizer::optimizeIndices(std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices) {
+    if (vertices.empty() || indices.size() < 3 || indices.size() % 3 != 0) return;
+
+    std::vector<size_t> clusters;
+    indices = MeshOptimizer::optimizeVertexCache(indices, vertices.size(), clusters);
+    MeshOptimizer::optimizeOverdraw(indices, vertices, clusters);
+}
@@ -0,0 +1,71 @@
+#include "render.hpp"
+
+MaterialPalette::MaterialPalette() {
+    // index 0 is the default material every renderable starts out with
+    this->materials.push_back(Material());
+}
+
+GLushort MaterialPalette::addMaterial(const Material & material) {
+    for (unsigned int i=0;i<this->materials.size();i++)
+        if (this->materials[i] == material) return static_cast<GLushort>(i);
+
+    if (this->materials.size() >= MaterialPalette::MAX_MATERIALS) {
+        std::cerr << "Material palette is full, falling back to default material" << std::endl;
+        return 0;
+    }
+
+    this->materials.push_back(material);
+    this->dirty = true;
+
+    return static_cast<GLushort>(this->materials.size() - 1);
+}
+
+Material MaterialPalette::getMaterial(const GLushort index) {
+    if (index >= this->materials.size()) return this->materials[0];
+
+    return this->materials[index];
+}
+
+void MaterialPalette::bind(Shader * shader) {
+    if (shader == nullptr) return;
+
+    if (this->buffer == 0) {
+        glGenBuffers(1, &this->buffer);
+        glGenTextures(1, &this->texture);
+    }
+
+    glActiveTexture(GL_TEXTURE0 + MaterialPalette::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+
+    if (this->dirty) {
+        std::vector<glm::vec4> texels;
+        texels.reserve(this->materials.size() * MaterialPalette::TEXELS_PER_MATERIAL);
+        for (auto & material : this->materials) {
+            texels.push_back(material.emissiveColor);
+            texels.push_back(material.ambientColor);
+            texels.push_back(material.diffuseColor);
+            texels.push_back(material.specularColor);
+            texels.push_back(glm::vec4(material.shininess, 0.0f, 0.0f, 0.0f));
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+        glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), &texels[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->buffer);
+
+        this->dirty = false;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+
+    shader->setInt("materials", MaterialPalette::TEXTURE_UNIT);
+}
+
+MaterialPalette::~MaterialPalette() {
+    if (this->texture != 0) glDeleteTextures(1, &this->texture);
+    if (this->buffer != 0) glDeleteBuffers(1, &this->buffer);
+
+    MaterialPalette::singleton = nullptr;
+}
+
+MaterialPalette * MaterialPalette::singleton = nullptr;
@@ -0,0 +1,239 @@
+#include "render.hpp"
+
+/*
+ * Both buffers hold every slot as position and age followed by velocity and lifetime,
+ * a lifetime of zero marks a slot that has not been spawned into yet
+ */
+bool ParticleSystem::init(const std::string & root, const GLuint capacity) {
+    if (this->initialized || capacity == 0) return this->initialized;
+
+    this->updateShader = ShaderRegistry::instance()->getShader(root + "/res/shaders/particles_update", {},
+        { "outPosition", "outVelocity" });
+    this->renderShader = ShaderRegistry::instance()->getShader(root + "/res/shaders/particles");
+    this->capacity = capacity;
+
+    const std::vector<glm::vec4> empty(this->capacity * 2, glm::vec4(0.0f));
+
+    glGenBuffers(2, this->buffers);
+    glGenVertexArrays(2, this->updateVertexArrays);
+    glGenVertexArrays(2, this->renderVertexArrays);
+
+    for (int i=0;i<2;i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, empty.size() * sizeof(glm::vec4), empty.data(), GL_DYNAMIC_COPY);
+
+        // the simulation reads every slot as a vertex, drawing reads it once per quad
+        const GLuint vertexArrays[2] = { this->updateVertexArrays[i], this->renderVertexArrays[i] };
+        for (int j=0;j<2;j++) {
+            glBindVertexArray(vertexArrays[j]);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+            glVertexAttribDivisor(0, j);
+            glVertexAttribDivisor(1, j);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    this->initialized = true;
+
+    return true;
+}
+
+/*
+ * Takes the first free range that fits rate times lifetime particles, their slots are cleared
+ * so that the simulation staggers their births. Returns the emitter, -1 if there is no room
+ */
+int ParticleSystem::spawn(const ParticleEmitter & emitter) {
+    if (!this->initialized || emitter.rate <= 0.0f || emitter.lifetime <= 0.0f) return -1;
+
+    const GLuint count = static_cast<GLuint>(glm::ceil(emitter.rate * emitter.lifetime));
+
+    // removed emitters leave their index and their slots to the next one
+    size_t index = 0;
+    while (index < this->ranges.size() && this->ranges[index].active) index++;
+    if (index >= static_cast<size_t>(ParticleSystem::MAX_EMITTERS)) {
+        std::cerr << "No more than " << ParticleSystem::MAX_EMITTERS << " particle emitters" << std::endl;
+        return -1;
+    }
+
+    std::vector<const ParticleRange *> used;
+    for (auto & range : this->ranges)
+        if (range.active) used.push_back(&range);
+    std::sort(used.begin(), used.end(),
+        [] (const ParticleRange * a, const ParticleRange * b) { return a->first < b->first; });
+
+    // first fit
+    GLuint first = 0;
+    for (auto * range : used) {
+        if (range->first - first >= count) break;
+        first = range->first + range->count;
+    }
+
+    if (this->capacity - first < count) {
+        std::cerr << "No room for " << count << " more particles" << std::endl;
+        return -1;
+    }
+
+    ParticleRange range;
+    range.emitter = emitter;
+    range.emitter.direction = glm::length(emitter.direction) > 0.0f ? glm::normalize(emitter.direction) : glm::vec3(0, 1, 0);
+    range.first = first;
+    range.count = count;
+    range.active = true;
+
+    if (index < this->ranges.size()) this->ranges[index] = range;
+    else this->ranges.push_back(range);
+
+    const std::vector<glm::vec4> empty(count * 2, glm::vec4(0.0f));
+    for (int i=0;i<2;i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffers[i]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * 2 * sizeof(glm::vec4), empty.size() * sizeof(glm::vec4), empty.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return index;
+}
+
+void ParticleSystem::move(const int emitter, const glm::vec3 & position) {
+    if (emitter < 0 || static_cast<size_t>(emitter) >= this->ranges.size()) return;
+
+    this->ranges[emitter].emitter.position = position;
+}
+
+// the particles left in the range disappear with the next update
+void ParticleSystem::remove(const int emitter) {
+    if (emitter < 0 || static_cast<size_t>(emitter) >= this->ranges.size()) return;
+
+    this->ranges[emitter].active = false;
+    while (!this->ranges.empty() && !this->ranges.back().active) this->ranges.pop_back();
+}
+
+GLuint ParticleSystem::getUsedSlots() {
+    GLuint used = 0;
+    for (auto & range : this->ranges)
+        if (range.active) used = std::max(used, range.first + range.count);
+
+    return used;
+}
+
+void ParticleSystem::setEmitterUniforms(Shader * shader) {
+    shader->setInt("numberOfEmitters", this->ranges.size());
+
+    for (size_t i=0;i<this->ranges.size();i++) {
+        const ParticleRange & range = this->ranges[i];
+        const ParticleEmitter & emitter = range.emitter;
+        const std::string index = "[" + std::to_string(i) + "]";
+
+        shader->setVec4("emitterSlots" + index, glm::vec4(range.first, range.count, range.active ? 1.0f : 0.0f, emitter.rate));
+        shader->setVec4("emitterPositions" + index, glm::vec4(emitter.position, emitter.spread));
+        shader->setVec4("emitterDirections" + index, glm::vec4(emitter.direction, emitter.speed));
+        shader->setVec4("emitterGravity" + index, glm::vec4(emitter.gravity, emitter.lifetime));
+        shader->setVec4("emitterStartColors" + index, emitter.startColor);
+        shader->setVec4("emitterEndColors" + index, emitter.endColor);
+        shader->setFloat("emitterSizes" + index, emitter.size);
+    }
+}
+
+/*
+ * Called once per frame, advances every slot by the time since the last call and writes them into the other buffer
+ */
+void ParticleSystem::update() {
+    const Uint32 now = SDL_GetTicks();
+    // a long stall would otherwise let all particles expire at once
+    const float deltaTime = this->lastUpdate == 0 ? 0.0f : std::min(static_cast<float>(now - this->lastUpdate) / 1000.0f, 0.1f);
+    this->lastUpdate = now;
+
+    const GLuint slots = this->getUsedSlots();
+    if (!this->initialized || this->updateShader == nullptr || slots == 0) return;
+
+    this->updateShader->use();
+    if (!this->updateShader->isBeingUsed()) return;
+
+    this->time += deltaTime;
+    this->updateShader->setFloat("deltaTime", deltaTime);
+    this->updateShader->setFloat("time", this->time);
+    this->setEmitterUniforms(this->updateShader);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(this->updateVertexArrays[this->current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, this->buffers[1 - this->current]);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, slots);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    this->updateShader->stopUse();
+
+    this->current = 1 - this->current;
+}
+
+/*
+ * Additive, so that the unsorted particles blend the same in any order. Depth is tested but not written
+ */
+void ParticleSystem::render() {
+    const GLuint slots = this->getUsedSlots();
+    if (!this->initialized || this->renderShader == nullptr || slots == 0) return;
+
+    // the depth of the bound framebuffer cannot be sampled while it is being tested against
+    const bool softFade = this->sceneDepth.copy();
+
+    this->renderShader->use();
+    if (!this->renderShader->isBeingUsed()) return;
+
+    this->renderShader->setMat4("view", Camera::instance()->getViewMatrix());
+    this->renderShader->setMat4("projection", Camera::instance()->getPerspective());
+    this->setEmitterUniforms(this->renderShader);
+
+    glActiveTexture(GL_TEXTURE0 + ParticleSystem::DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, softFade ? this->sceneDepth.getTexture() : 0);
+    glActiveTexture(GL_TEXTURE0);
+    this->renderShader->setInt("sceneDepth", ParticleSystem::DEPTH_UNIT);
+    this->renderShader->setBool("softFade", softFade);
+    this->renderShader->setFloat("softness", ParticleSystem::SOFTNESS);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    glBindVertexArray(this->renderVertexArrays[this->current]);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, slots);
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+
+    this->renderShader->stopUse();
+}
+
+void ParticleSystem::cleanUp() {
+    if (this->buffers[0] != 0) glDeleteBuffers(2, this->buffers);
+    if (this->updateVertexArrays[0] != 0) glDeleteVertexArrays(2, this->updateVertexArrays);
+    if (this->renderVertexArrays[0] != 0) glDeleteVertexArrays(2, this->renderVertexArrays);
+    this->sceneDepth.cleanUp();
+
+    for (int i=0;i<2;i++) {
+        this->buffers[i] = 0;
+        this->updateVertexArrays[i] = 0;
+        this->renderVertexArrays[i] = 0;
+    }
+
+    this->ranges.clear();
+    this->initialized = false;
+}
+
+ParticleSystem::~ParticleSystem() {
+    this->cleanUp();
+    ParticleSystem::singleton = nullptr;
+}
+
+constexpr float ParticleSystem::SOFTNESS;
+
+ParticleSystem * ParticleSystem::singleton = nullptr;
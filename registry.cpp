@@ -0,0 +1,110 @@
+#include "render.hpp"
+
+ShaderRegistry::ShaderRegistry() {
+    char * prefPath = SDL_GetPrefPath("game_template", "shader_cache");
+    if (prefPath != nullptr) {
+        this->cacheDir = prefPath;
+        SDL_free(prefPath);
+    } else std::cerr << "No shader cache directory: " << SDL_GetError() << std::endl;
+}
+
+std::string ShaderRegistry::createKey(const std::string & file_name, const std::vector<std::string> & defines) {
+    std::string key(file_name);
+    for (auto & define : defines) key.append("|" + define);
+    return key;
+}
+
+Shader * ShaderRegistry::getShader(const std::string & file_name, const std::vector<std::string> & defines,
+        const std::vector<std::string> & feedbackVaryings) {
+    const std::string key = ShaderRegistry::createKey(file_name, defines);
+    std::map<std::string, Shader *>::iterator val(this->SHADERS.find(key));
+
+    if (val != this->SHADERS.end()) return val->second;
+
+    Shader * shader = new Shader(file_name, defines, feedbackVaryings);
+    this->SHADERS[key] = shader;
+
+    return shader;
+}
+
+/*
+ * The program of the same sources with additional defines, compiled once and shared.
+ * The built-in program has no variants
+ */
+Shader * ShaderRegistry::getVariant(Shader * shader, const std::vector<std::string> & defines) {
+    if (shader == nullptr || shader->getFileName().empty() || defines.empty()) return shader;
+
+    std::vector<std::string> allDefines = shader->getDefines();
+    allDefines.insert(allDefines.end(), defines.begin(), defines.end());
+    std::sort(allDefines.begin(), allDefines.end());
+    allDefines.erase(std::unique(allDefines.begin(), allDefines.end()), allDefines.end());
+
+    return this->getShader(shader->getFileName(), allDefines, shader->getFeedbackVaryings());
+}
+
+Shader * ShaderRegistry::acquireDefaultShader() {
+    if (this->defaultShader == nullptr) this->defaultShader = new Shader();
+    this->defaultShaderReferences++;
+
+    return this->defaultShader;
+}
+
+void ShaderRegistry::releaseDefaultShader() {
+    if (this->defaultShaderReferences == 0) return;
+
+    this->defaultShaderReferences--;
+    if (this->defaultShaderReferences == 0 && this->defaultShader != nullptr) {
+        delete this->defaultShader;
+        this->defaultShader = nullptr;
+    }
+}
+
+/*
+ * Lets the driver compile and link on its own threads, programs are then polled for completion
+ * instead of blocking the first time they are used
+ */
+void ShaderRegistry::enableParallelCompile() {
+    if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    else return;
+
+    this->parallelCompile = true;
+}
+
+std::string ShaderRegistry::getProgramBinaryPath(const std::string & sources) {
+    if (this->cacheDir.empty() || !GLEW_ARB_get_program_binary) return "";
+
+    GLint numberOfFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numberOfFormats);
+    if (numberOfFormats <= 0) return "";
+
+    std::string driver;
+    const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (auto name : driverStrings) {
+        const GLubyte * value = glGetString(name);
+        if (value != nullptr) driver.append(reinterpret_cast<const char *>(value));
+    }
+
+    // FNV-1a: unlike std::hash it is stable between runs and builds
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : sources + driver) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+
+    return this->cacheDir + hex + ".bin";
+}
+
+ShaderRegistry::~ShaderRegistry() {
+    for (auto & shaderEntry : this->SHADERS) delete shaderEntry.second;
+    this->SHADERS.clear();
+
+    if (this->defaultShader != nullptr) delete this->defaultShader;
+
+    ShaderRegistry::singleton = nullptr;
+}
+
+ShaderRegistry * ShaderRegistry::singleton = nullptr;
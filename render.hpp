@@ -18,37 +18,48 @@ static const std::string DEFAULT_VERTEX_SHADER =
         "layout (location = 0) in vec3 position;\n"
         "layout (location = 1) in vec3 normal;\n"
         "layout (location = 2) in vec2 uvs;\n"
-        "layout (location = 3) in vec3 tangent;\n"
-        "layout (location = 4) in vec3 bitangent;\n"
-        "layout (location = 5) in mat4 model;\n"
-        "layout (location = 9) in vec4 emissiveMaterial;\n"
-        "layout (location = 10) in vec4 ambientMaterial;\n"
-        "layout (location = 11) in vec4 diffuseMaterial;\n"
-        "layout (location = 12) in vec4 specularMaterial;\n"
-        "layout (location = 13) in float shininessMaterial;\n"
+        "layout (location = 3) in vec4 tangent;\n"
+        "layout (location = 5) in vec3 instancePosition;\n"
+        "layout (location = 6) in vec4 instanceRotation;\n"
+        "layout (location = 7) in float instanceScale;\n"
+        "layout (location = 9) in uint materialIndex;\n"
         "uniform mat4 view;\n"
         "uniform mat4 projection;\n"
+        "uniform samplerBuffer materials;\n"
+        "uniform vec3 positionOffset;\n"
+        "uniform vec3 positionScale;\n"
         "out vec3 norm;\n"
         "out vec3 pos;\n"
+        "out float viewDepth;\n"
         "out vec4 emissiveColor;\n"
         "out vec4 ambientColor;\n"
         "out vec4 diffuseColor;\n"
         "out vec4 specularColor;\n"
         "out float shininess;\n"
+        "invariant gl_Position;\n"
+        "vec3 rotate(vec4 q, vec3 v) {\n"
+        "    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n"
+        "}\n"
         "void main() {\n"
-        "    pos = vec3(model * vec4(position, 1.0));\n"
-        "    emissiveColor = emissiveMaterial;\n"
-        "    ambientColor = ambientMaterial;\n"
-        "    diffuseColor = diffuseMaterial;\n"
-        "    specularColor = specularMaterial;\n"
-        "    shininess = shininessMaterial;\n"
-        "    gl_Position = projection * view * vec4(pos, 1.0);\n"
-        "    norm = normalize(mat3(transpose(inverse(model))) * normal);\n"
+        "    vec4 rotation = normalize(instanceRotation);\n"
+        "    vec3 meshPosition = positionOffset + position * positionScale;\n"
+        "    pos = instancePosition + instanceScale * rotate(rotation, meshPosition);\n"
+        "    int materialOffset = int(materialIndex) * 5;\n"
+        "    emissiveColor = texelFetch(materials, materialOffset);\n"
+        "    ambientColor = texelFetch(materials, materialOffset + 1);\n"
+        "    diffuseColor = texelFetch(materials, materialOffset + 2);\n"
+        "    specularColor = texelFetch(materials, materialOffset + 3);\n"
+        "    shininess = texelFetch(materials, materialOffset + 4).x;\n"
+        "    vec4 viewPos = view * vec4(pos, 1.0);\n"
+        "    gl_Position = projection * viewPos;\n"
+        "    viewDepth = -viewPos.z;\n"
+        "    norm = normalize(rotate(rotation, normal));\n"
         "}";
 static const std::string DEFAULT_FRAGMENT_SHADER =
         "#version 330 core\n"
         "in vec3 norm;\n"
         "in vec3 pos;\n"
+        "in float viewDepth;\n"
         "in vec4 emissiveColor;\n"
         "in vec4 ambientColor;\n"
         "in vec4 diffuseColor;\n"
@@ -58,18 +69,73 @@ static const std::string DEFAULT_FRAGMENT_SHADER =
         "uniform vec3 sunDirection;\n"
         "uniform vec3 sunLightColor;\n"
         "uniform vec3 eyePosition;\n"
+        "uniform samplerBuffer lights;\n"
+        "uniform usamplerBuffer lightGrid;\n"
+        "uniform usamplerBuffer lightIndices;\n"
+        "uniform vec2 clusterTileScale;\n"
+        "uniform float clusterDepthScale;\n"
+        "uniform float clusterDepthBias;\n"
+        "uniform int clusterCount[3];\n"
+        "uniform sampler2DArrayShadow shadowMap;\n"
+        "uniform mat4 shadowMatrices[4];\n"
+        "uniform float shadowSplits[4];\n"
+        "#ifdef DEFERRED\n"
+        "layout (location = 0) out vec4 gAlbedo;\n"
+        "layout (location = 1) out vec4 gNormal;\n"
+        "layout (location = 2) out vec4 gSpecular;\n"
+        "layout (location = 3) out vec4 gAmbient;\n"
+        "#else\n"
         "out vec4 fragColor;\n"
+        "#endif\n"
+        "float calculateShadow(vec3 position, float depth) {\n"
+        "    if (depth > shadowSplits[3]) return 1.0;\n"
+        "    int cascade = 0;\n"
+        "    while (cascade < 3 && depth > shadowSplits[cascade]) cascade++;\n"
+        "    vec4 shadowPos = shadowMatrices[cascade] * vec4(position, 1.0);\n"
+        "    vec3 coords = shadowPos.xyz / shadowPos.w * 0.5 + 0.5;\n"
+        "    return texture(shadowMap, vec4(coords.xy, cascade, coords.z));\n"
+        "}\n"
+        "void addClusterLights(vec3 eyeDir, inout vec3 diffuseLight, inout vec3 specularLight) {\n"
+        "    ivec3 cluster = ivec3(gl_FragCoord.xy * clusterTileScale, log(max(viewDepth, 0.0001)) * clusterDepthScale + clusterDepthBias);\n"
+        "    cluster = clamp(cluster, ivec3(0), ivec3(clusterCount[0], clusterCount[1], clusterCount[2]) - 1);\n"
+        "    uvec2 range = texelFetch(lightGrid, (cluster.z * clusterCount[1] + cluster.y) * clusterCount[0] + cluster.x).xy;\n"
+        "    for (uint i = 0u; i < range.y; i++) {\n"
+        "        int light = int(texelFetch(lightIndices, int(range.x + i)).r) * 3;\n"
+        "        vec4 positionRadius = texelFetch(lights, light);\n"
+        "        vec4 colorInner = texelFetch(lights, light + 1);\n"
+        "        vec4 directionOuter = texelFetch(lights, light + 2);\n"
+        "        vec3 toLight = positionRadius.xyz - pos;\n"
+        "        float distanceSquared = dot(toLight, toLight);\n"
+        "        vec3 lightDir = toLight * inversesqrt(max(distanceSquared, 0.0001));\n"
+        "        float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);\n"
+        "        falloff *= falloff;\n"
+        "        if (directionOuter.w > -1.5) falloff *= smoothstep(directionOuter.w, colorInner.w, dot(-lightDir, directionOuter.xyz));\n"
+        "        diffuseLight += max(dot(norm, lightDir), 0.0) * falloff * colorInner.rgb;\n"
+        "        specularLight += pow(max(dot(norm, normalize(lightDir + eyeDir)), 0.0), shininess) * falloff * colorInner.rgb;\n"
+        "    }\n"
+        "}\n"
         "void main() {\n"
         "    vec4 emission = emissiveColor * vec4(ambientLight, 1.0);\n"
         "    vec4 ambience = vec4(ambientLight,1) * ambientColor;\n"
-        "    vec3 lightDir = normalize(sunDirection - pos);\n"
-        "    float diff = max(dot(norm, lightDir), 0.1);\n"
-        "    vec4 diffuse = vec4(diff * sunLightColor, 1.0) * diffuseColor;\n"
+        "#ifdef DEFERRED\n"
+        "    gAlbedo = diffuseColor;\n"
+        "    gNormal = vec4(normalize(norm), shininess);\n"
+        "    gSpecular = specularColor;\n"
+        "    gAmbient = emission + ambience;\n"
+        "#else\n"
         "    vec3 eyeDir = normalize(eyePosition - pos);\n"
+        "    vec3 clusterDiffuse = vec3(0.0);\n"
+        "    vec3 clusterSpecular = vec3(0.0);\n"
+        "    addClusterLights(eyeDir, clusterDiffuse, clusterSpecular);\n"
+        "    float shadow = calculateShadow(pos, viewDepth);\n"
+        "    vec3 lightDir = normalize(sunDirection - pos);\n"
+        "    float diff = max(dot(norm, lightDir) * shadow, 0.1);\n"
+        "    vec4 diffuse = vec4(diff * sunLightColor + clusterDiffuse, 1.0) * diffuseColor;\n"
         "    vec3 halfDir = normalize(lightDir + eyeDir);\n"
-        "    float spec = pow(max(dot(norm, halfDir), 0.1), shininess);\n"
-        "    vec4 specular = vec4(spec * sunLightColor, 1) * specularColor;\n"
+        "    float spec = pow(max(dot(norm, halfDir), 0.1), shininess) * shadow;\n"
+        "    vec4 specular = vec4(spec * sunLightColor + clusterSpecular, 1) * specularColor;\n"
         "    fragColor = emission + ambience + diffuse + specular;\n"
+        "#endif\n"
         "}";
 
 
@@ -81,6 +147,44 @@ class Material {
         glm::vec4 specularColor = glm::vec4(0.3f,0.3f,0.3f,1.0f);
         float shininess = 1.0f;
         Material() {};
+        bool operator==(const Material & other) const {
+            return this->ambientColor == other.ambientColor && this->emissiveColor == other.emissiveColor &&
+                    this->diffuseColor == other.diffuseColor && this->specularColor == other.specularColor &&
+                    this->shininess == other.shininess;
+        }
+};
+
+class InstanceTransform {
+public:
+    glm::vec3 position = glm::vec3(0.0f);
+    GLshort rotation[4] = { 0, 0, 0, SHRT_MAX };
+    float scale = 1.0f;
+
+    InstanceTransform() {};
+    InstanceTransform(const glm::vec3 & position, const glm::quat & rotation, const float scale) {
+        this->position = position;
+        this->scale = scale;
+
+        // rotation quaternion (x, y, z, w) as 16 bit snorm
+        const glm::quat q = glm::normalize(rotation);
+        const float components[4] = { q.x, q.y, q.z, q.w };
+        for (int i=0;i<4;i++)
+            this->rotation[i] = static_cast<GLshort>(glm::round(glm::clamp(components[i], -1.0f, 1.0f) * SHRT_MAX));
+    }
+};
+
+// the clip of the mesh's VertexAnimation an instance plays and how many seconds it is ahead of the others
+class InstanceAnimation {
+public:
+    float timeOffset = 0.0f;
+    GLushort clip = 0;
+    GLushort padding = 0;
+
+    InstanceAnimation() {};
+    InstanceAnimation(const GLushort clip, const float timeOffset) {
+        this->clip = clip;
+        this->timeOffset = timeOffset;
+    }
 };
 
 class Vertex {
@@ -97,29 +201,91 @@ public:
     }
 };
 
+class VertexAttribute {
+public:
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+class VertexBounds {
+public:
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(1.0f);
+};
+
+// 24 bytes: normal and tangent as 10_10_10_2 snorm, tangent.w holding the bitangent sign, half float uvs
+class PackedVertex {
+public:
+    glm::vec3 position;
+    GLuint normal;
+    GLuint tangent;
+    GLushort uv[2];
+};
+
+// 20 bytes: same as PackedVertex but with the position quantized to 16 bit within the mesh bounds
+class QuantizedVertex {
+public:
+    GLushort position[4];
+    GLuint normal;
+    GLuint tangent;
+    GLushort uv[2];
+};
+
+template <typename V>
+class VertexLayout final {
+    public:
+        static std::vector<VertexAttribute> getAttributes();
+        static V encode(const Vertex & vertex, const VertexBounds & bounds);
+};
+
+template<> std::vector<VertexAttribute> VertexLayout<PackedVertex>::getAttributes();
+template<> PackedVertex VertexLayout<PackedVertex>::encode(const Vertex & vertex, const VertexBounds & bounds);
+template<> std::vector<VertexAttribute> VertexLayout<QuantizedVertex>::getAttributes();
+template<> QuantizedVertex VertexLayout<QuantizedVertex>::encode(const Vertex & vertex, const VertexBounds & bounds);
+
 class Shader final {
     private:
         std::string m_file_name;
+        std::vector<std::string> m_defines;
+        // captured by transform feedback, they have to be known before linking
+        std::vector<std::string> m_feedbackVaryings;
 
         GLuint m_program = 0;
-        GLuint m_shaders[NUM_SHADERS];
+        GLuint m_shaders[NUM_SHADERS] = { 0, 0 };
+
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::string cacheFile;
 
         bool loaded = true;
         bool used = false;
+        bool pending = false;
+        bool fromBinary = false;
 
         std::string read(const int type) const;
+        std::string addDefines(const std::string & source) const;
         void checkForError(GLuint shader, GLuint flag, bool isProgram,
                 const std::string & errorMessage);
         GLuint create(const unsigned int type, const std::string text);
         void init(const std::string & file_name);
+        void submit();
+        bool loadProgramBinary(const std::string & cacheFile);
+        void saveProgramBinary(const std::string & cacheFile);
 
     public:
         Shader();
-        Shader(const std::string & file_name);
+        Shader(const std::string & file_name, const std::vector<std::string> & defines = {},
+                const std::vector<std::string> & feedbackVaryings = {});
         virtual ~Shader();
         bool hasBeenLoaded() {
+            this->finish();
             return this->loaded;
         };
+        bool isReady();
+        void finish();
         bool isBeingUsed() {
             return this->used;
         };
@@ -136,39 +302,527 @@ class Shader final {
         void setMat2(const std::string &name, const glm::mat2 &mat) const;
         void setMat3(const std::string &name, const glm::mat3 &mat) const;
         void setMat4(const std::string &name, const glm::mat4 &mat) const;
+        std::string getFileName() const {
+            return this->m_file_name;
+        }
+        std::vector<std::string> getDefines() const {
+            return this->m_defines;
+        }
+        std::vector<std::string> getFeedbackVaryings() const {
+            return this->m_feedbackVaryings;
+        }
+        // camera, sun, materials, light clusters and shadows, everything lit geometry needs
+        void setSceneUniforms();
         GLuint getId() const;
         void use();
         void stopUse();
         void dumpActiveShaderAttributes();
 };
 
-class Texture {
+class ShaderRegistry final {
+    private:
+        static ShaderRegistry * singleton;
+        std::string cacheDir = "";
+        std::map<std::string, Shader *> SHADERS;
+        Shader * defaultShader = nullptr;
+        unsigned int defaultShaderReferences = 0;
+        std::vector<std::string> globalDefines;
+        bool parallelCompile = false;
+        ShaderRegistry();
+    public:
+        ~ShaderRegistry();
+        static ShaderRegistry * instance() {
+            if (ShaderRegistry::singleton == nullptr) ShaderRegistry::singleton = new ShaderRegistry();
+            return ShaderRegistry::singleton;
+        }
+        static std::string createKey(const std::string & file_name, const std::vector<std::string> & defines);
+
+        // varyings belong to the sources, they are only used when the program is first created
+        Shader * getShader(const std::string & file_name, const std::vector<std::string> & defines = {},
+                const std::vector<std::string> & feedbackVaryings = {});
+        Shader * getVariant(Shader * shader, const std::vector<std::string> & defines);
+        Shader * acquireDefaultShader();
+        void releaseDefaultShader();
+        std::string getProgramBinaryPath(const std::string & sources);
+        void enableParallelCompile();
+        bool hasParallelCompile() {
+            return this->parallelCompile;
+        }
+        // prepended to every program compiled afterwards, e.g. to select the render path at startup
+        void addGlobalDefine(const std::string & define) {
+            this->globalDefines.push_back(define);
+        }
+        std::vector<std::string> getGlobalDefines() {
+            return this->globalDefines;
+        }
+};
+
+class MaterialPalette final {
+    private:
+        static MaterialPalette * singleton;
+        std::vector<Material> materials;
+        GLuint buffer = 0, texture = 0;
+        bool dirty = true;
+        MaterialPalette();
+    public:
+        static const GLushort MAX_MATERIALS = 0xffff;
+        static const GLint TEXTURE_UNIT = 15;
+        static const int TEXELS_PER_MATERIAL = 5;
+
+        ~MaterialPalette();
+        static MaterialPalette * instance() {
+            if (MaterialPalette::singleton == nullptr) MaterialPalette::singleton = new MaterialPalette();
+            return MaterialPalette::singleton;
+        }
+        GLushort addMaterial(const Material & material);
+        Material getMaterial(const GLushort index);
+        void bind(Shader * shader);
+};
+
+/*
+ * Point and spot lights binned into a view space grid of screen tiles and exponential depth slices,
+ * fragments only loop over the lights of the cluster they fall into
+ */
+class LightClusters final {
+    private:
+        static LightClusters * singleton;
+
+        GLuint lightsBuffer = 0, lightsTexture = 0;
+        GLuint gridBuffer = 0, gridTexture = 0;
+        GLuint indicesBuffer = 0, indicesTexture = 0;
+
+        glm::mat4 projection = glm::mat4(0.0f);
+        glm::vec2 viewportSize = glm::vec2(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+        float nearPlane = 0.1f;
+        float farPlane = 10000.0f;
+
+        // view space bounds of every cluster, one array per component so that 4 clusters are tested at once
+        std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+        std::vector<std::vector<GLushort>> clusterLights;
+        std::vector<glm::vec4> lights;
+        GLushort numberOfLights = 0;
+
+        LightClusters();
+        void updateBounds();
+        GLint getSlice(const float depth);
+        void assign(const glm::vec3 & center, const float radius, const GLushort index);
+        void upload();
+    public:
+        static const GLint TILES_X = 16;
+        static const GLint TILES_Y = 9;
+        static const GLint SLICES = 24;
+        static const GLint CLUSTERS = TILES_X * TILES_Y * SLICES;
+        static const GLushort MAX_LIGHTS = 1024;
+        static const GLint LIGHTS_UNIT = 11;
+        static const GLint GRID_UNIT = 12;
+        static const GLint INDICES_UNIT = 13;
+
+        LightClusters(const LightClusters&) = delete;
+        LightClusters& operator=(const LightClusters&) = delete;
+        ~LightClusters();
+
+        static LightClusters * instance() {
+            if (LightClusters::singleton == nullptr) LightClusters::singleton = new LightClusters();
+            return LightClusters::singleton;
+        }
+
+        GLushort getNumberOfLights() {
+            return this->numberOfLights;
+        }
+        void update();
+        void bind(Shader * shader);
+};
+
+/*
+ * Albedo, normal and shininess, specular and the light independent ambient term of the nearest surface,
+ * sized to the viewport. The deferred path lights it once per pixel instead of once per shaded fragment
+ */
+class GBuffer final {
+    private:
+        GLuint framebuffer = 0;
+        GLuint textures[4] = { 0, 0, 0, 0 };
+        GLuint depthTexture = 0;
+        GLuint vertexArray = 0;
+        GLint previousFramebuffer = 0;
+        // only grows, a smaller viewport renders into the lower left corner
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLsizei viewportWidth = 0;
+        GLsizei viewportHeight = 0;
+
+        bool create(const GLsizei width, const GLsizei height);
+    public:
+        static const int NUMBER_OF_TARGETS = 4;
+        // followed by one unit per target and the depth
+        static const GLint TEXTURE_UNIT = 4;
+
+        GBuffer() {};
+        GBuffer(const GBuffer&) = delete;
+        GBuffer& operator=(const GBuffer&) = delete;
+        ~GBuffer();
+
+        bool begin();
+        void end();
+        void light(Shader * shader);
+        void cleanUp();
+};
+
+/*
+ * Sun shadows in depth array layers, one orthographic cascade per slice of the view frustum.
+ * Static casters are kept in their own layers and only redrawn when the sun turns or a cascade
+ * moves to another snap position, each frame copies them over and adds the dynamic casters
+ */
+class ShadowCascades final {
+    private:
+        static ShadowCascades * singleton;
+
+        GLuint drawFramebuffer = 0, readFramebuffer = 0;
+        GLuint staticDepth = 0, depth = 0;
+
+        float distance = ShadowCascades::DEFAULT_DISTANCE;
+        glm::vec3 lightDirection = glm::vec3(0.0f);
+        glm::mat4 lightView = glm::mat4(1.0f);
+        glm::mat4 projections[4];
+        glm::vec3 centers[4];
+        float splits[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+        glm::vec3 staticLightDirection = glm::vec3(0.0f);
+        glm::vec3 staticCenters[4];
+        bool staticValid[4] = { false, false, false, false };
+
+        ShadowCascades() {};
+        bool create();
+        void fit();
+        void renderLayer(const GLint layer, Shader * depthShader, std::function<void(Shader *)> renderCasters);
+    public:
+        static const int CASCADES = 4;
+        static const GLsizei SIZE = 2048;
+        static const GLint TEXTURE_UNIT = 10;
+        // cascades only move in steps of this many texels, the static layers are kept until they do
+        static const int SNAP_TEXELS = 32;
+        static constexpr float DEFAULT_DISTANCE = 250.0f;
+        // casters this far beyond a cascade towards the sun still throw their shadow into it
+        static constexpr float CASTER_RANGE = 500.0f;
+
+        ShadowCascades(const ShadowCascades&) = delete;
+        ShadowCascades& operator=(const ShadowCascades&) = delete;
+        ~ShadowCascades();
+
+        static ShadowCascades * instance() {
+            if (ShadowCascades::singleton == nullptr) ShadowCascades::singleton = new ShadowCascades();
+            return ShadowCascades::singleton;
+        }
+
+        void setDistance(const float distance) {
+            this->distance = distance;
+            this->invalidate();
+        }
+        float getDistance() {
+            return this->distance;
+        }
+        // static casters were added or changed
+        void invalidate() {
+            for (auto & valid : this->staticValid) valid = false;
+        }
+        void update(Shader * depthShader, std::function<void(Shader *)> renderStatic, std::function<void(Shader *)> renderDynamic);
+        void bind(Shader * shader);
+};
+
+/*
+ * Renders the scene offscreen at a fraction of the window size, chosen from GPU timer queries
+ * to hold the target frame time, and scales it up to the window with a sharpening filter.
+ * Anything drawn after end() is at the native resolution of the window
+ */
+class DynamicResolution final {
     private:
-        unsigned int id = 0;
+        Shader * shader = nullptr;
+        GLuint framebuffer = 0, colorTexture = 0, depthBuffer = 0, vertexArray = 0;
+        // allocated for the largest scale so that changing it is only a matter of the viewport
+        GLsizei width = 0, height = 0;
+        GLsizei renderWidth = 0, renderHeight = 0;
+        GLsizei windowWidth = 0, windowHeight = 0;
+
+        static const unsigned int QUERY_FRAMES = 4;
+        GLuint queries[QUERY_FRAMES] = { 0, 0, 0, 0 };
+        bool issued[QUERY_FRAMES] = { false, false, false, false };
+        unsigned long frame = 0;
+        bool active = false;
+
+        float scale = DynamicResolution::DEFAULT_MAX_SCALE;
+        float minScale = DynamicResolution::DEFAULT_MIN_SCALE;
+        float maxScale = DynamicResolution::DEFAULT_MAX_SCALE;
+        float targetFrameTime = DynamicResolution::DEFAULT_TARGET_FRAME_TIME;
+        float sharpness = DynamicResolution::DEFAULT_SHARPNESS;
+        float gpuFrameTime = 0.0f;
+
+        bool create(const GLsizei width, const GLsizei height);
+        void adjustScale();
+    public:
+        static constexpr float DEFAULT_MIN_SCALE = 0.5f;
+        static constexpr float DEFAULT_MAX_SCALE = 1.0f;
+        // milliseconds, one refresh at 60 Hz
+        static constexpr float DEFAULT_TARGET_FRAME_TIME = 16.6f;
+        static constexpr float DEFAULT_SHARPNESS = 0.5f;
+        static constexpr float SCALE_STEP = 0.05f;
+
+        DynamicResolution(Shader * shader);
+        DynamicResolution(const DynamicResolution&) = delete;
+        DynamicResolution& operator=(const DynamicResolution&) = delete;
+        ~DynamicResolution();
+
+        void setScaleBounds(const float minScale, const float maxScale);
+        void setTargetFrameTime(const float targetFrameTime) {
+            if (targetFrameTime > 0.0f) this->targetFrameTime = targetFrameTime;
+        }
+        void setSharpness(const float sharpness) {
+            this->sharpness = glm::clamp(sharpness, 0.0f, 1.0f);
+        }
+        float getScale() {
+            return this->scale;
+        }
+        float getGpuFrameTime() {
+            return this->gpuFrameTime;
+        }
+        void begin(const GLsizei windowWidth, const GLsizei windowHeight);
+        void end();
+        void cleanUp();
+};
+
+/*
+ * Copy of the depth of the framebuffer being drawn into, in its format so that it can be blitted,
+ * for passes that sample the opaque scene or test against it while drawing into targets of their own
+ */
+class DepthCopy final {
+    private:
+        GLuint framebuffer = 0, texture = 0;
+        GLsizei width = 0, height = 0;
+        GLenum format = GL_NONE;
+    public:
+        DepthCopy() {};
+        DepthCopy(const DepthCopy&) = delete;
+        DepthCopy& operator=(const DepthCopy&) = delete;
+        ~DepthCopy();
+
+        // false for multisampled framebuffers or ones without depth
+        bool copy();
+        // attaches the copy to the bound draw framebuffer
+        void attach();
+        GLuint getTexture() {
+            return this->texture;
+        }
+        void cleanUp();
+};
+
+/*
+ * Weighted blended order-independent transparency. Translucent surfaces add their color and coverage,
+ * weighted by their distance, into the accumulation target and multiply their transmittance into its alpha,
+ * the revealage, while the weights add up in the second target. Neither depends on the order surfaces arrive in,
+ * so translucent instances are drawn instanced and unsorted. The composite then puts the weighted average
+ * over the opaque scene, by as much as the revealage leaves of it
+ */
+class TransparencyBuffer final {
+    private:
+        Shader * shader = nullptr;
+        GLuint framebuffer = 0;
+        GLuint textures[2] = { 0, 0 };
+        GLuint vertexArray = 0;
+        GLint previousFramebuffer = 0;
+        // only grows, a smaller viewport renders into the lower left corner
+        GLsizei width = 0;
+        GLsizei height = 0;
+        // translucent surfaces are depth tested against the opaque scene without writing depth
+        DepthCopy depth;
+
+        bool create(const GLsizei width, const GLsizei height);
+    public:
+        // followed by one unit for the weights
+        static const GLint TEXTURE_UNIT = 18;
+
+        TransparencyBuffer(Shader * shader);
+        TransparencyBuffer(const TransparencyBuffer&) = delete;
+        TransparencyBuffer& operator=(const TransparencyBuffer&) = delete;
+        ~TransparencyBuffer();
+
+        bool begin();
+        // composites into the framebuffer bound at begin()
+        void end();
+        void cleanUp();
+};
+
+// emits continuously for as long as it exists, what it emits is spawned and simulated on the GPU
+class ParticleEmitter {
+    public:
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f, 1.0f, 0.0f);
+        // half angle of the cone particles leave in, radians
+        float spread = 0.3f;
+        float speed = 5.0f;
+        // particles per second
+        float rate = 1000.0f;
+        // seconds
+        float lifetime = 2.0f;
+        float size = 0.2f;
+        glm::vec4 startColor = glm::vec4(1.0f, 0.8f, 0.4f, 1.0f);
+        glm::vec4 endColor = glm::vec4(1.0f, 0.2f, 0.0f, 0.0f);
+        glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+};
+
+// the slots of the particle buffers an emitter respawns its particles in
+class ParticleRange {
+    public:
+        ParticleEmitter emitter;
+        GLuint first = 0;
+        GLuint count = 0;
+        bool active = false;
+};
+
+/*
+ * Every emitter owns a range of particle slots sized for its rate and lifetime. The slots are
+ * simulated and respawned by a vertex shader whose outputs are captured into the other of two
+ * buffers, which are then drawn as instanced camera facing quads. Past spawning an emitter the
+ * CPU only sets uniforms, the number of particles does not show up in the frame loop.
+ */
+class ParticleSystem final {
+    private:
+        static ParticleSystem * singleton;
+
+        Shader * updateShader = nullptr;
+        Shader * renderShader = nullptr;
+
+        // ping-ponged: one is read while the other is written
+        GLuint buffers[2] = { 0, 0 };
+        GLuint updateVertexArrays[2] = { 0, 0 };
+        GLuint renderVertexArrays[2] = { 0, 0 };
+        unsigned int current = 0;
+
+        // sampled for the soft fade where the particles meet geometry
+        DepthCopy sceneDepth;
+
+        GLuint capacity = 0;
+        std::vector<ParticleRange> ranges;
+        Uint32 lastUpdate = 0;
+        float time = 0.0f;
+        bool initialized = false;
+
+        ParticleSystem() {};
+        GLuint getUsedSlots();
+        void setEmitterUniforms(Shader * shader);
+    public:
+        static const GLuint DEFAULT_CAPACITY = 1 << 20;
+        static const int MAX_EMITTERS = 16;
+        static const GLint DEPTH_UNIT = 17;
+        // distance over which particles fade out in front of geometry
+        static constexpr float SOFTNESS = 0.5f;
+
+        ParticleSystem(const ParticleSystem&) = delete;
+        ParticleSystem& operator=(const ParticleSystem&) = delete;
+        ~ParticleSystem();
+
+        static ParticleSystem * instance() {
+            if (ParticleSystem::singleton == nullptr) ParticleSystem::singleton = new ParticleSystem();
+            return ParticleSystem::singleton;
+        }
+
+        bool init(const std::string & root, const GLuint capacity = ParticleSystem::DEFAULT_CAPACITY);
+        int spawn(const ParticleEmitter & emitter);
+        void move(const int emitter, const glm::vec3 & position);
+        void remove(const int emitter);
+        void update();
+        void render();
+        void cleanUp();
+};
+
+class TextureLevel {
+    public:
+        GLsizei width = 0;
+        GLsizei height = 0;
+        std::vector<unsigned char> data;
+};
+
+// offline BC1 (opaque), BC3 (translucent) and BC5 (normals) encoding of a full mip chain
+class TextureEncoder final {
+    public:
+        static bool isSupported();
+        static GLint getBlockSize(const GLenum format);
+        static std::vector<TextureLevel> encode(SDL_Surface * surface, const bool normalMap, GLenum & format);
+        static std::string getCachePath(const std::string & path);
+        static bool loadCache(const std::string & path, GLenum & format, std::vector<TextureLevel> & levels, const GLsizei maxSize = INT_MAX);
+        static bool loadCacheLevel(const std::string & path, const GLint level, unsigned char * destination, const size_t size);
+        static bool saveCache(const std::string & path, const GLenum format, const std::vector<TextureLevel> & levels);
+};
+
+class TextureArray;
+
+/*
+ * Pixel data is only held until uploaded when it can be read again on demand:
+ * compressed levels from the texture cache, plain images by decoding the file again.
+ */
+class Texture : public std::enable_shared_from_this<Texture> {
+    private:
+        TextureArray * array = nullptr;
+        GLint layer = -1;
         std::string type;
         std::string path;
         bool loaded = false;
         bool valid = false;
+        bool streamable = true;
+        bool cached = false;
         GLenum imageFormat;
+        GLenum compressedFormat = 0;
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLint bytesPerPixel = 0;
+        std::vector<TextureLevel> levels;
         SDL_Surface * textureSurface = nullptr;
+        std::mutex pixelsMutex;
     public:
-        unsigned int getId() {
-            return  this->id;
+        Texture() {};
+        Texture(const Texture&) = delete;
+        Texture& operator=(const Texture&) = delete;
+
+        TextureArray * getArray() {
+            return this->array;
+        }
+        GLint getLayer() {
+            return this->layer;
+        }
+        void setArrayLayer(TextureArray * array, const GLint layer) {
+            this->array = array;
+            this->layer = layer;
         }
         std::string getType() {
             return this->type;
         }
+        std::string getPath() {
+            return this->path;
+        }
         bool isValid() {
             return this->valid;
         }
         GLenum getImageFormat() {
             return this->imageFormat;
         }
-        SDL_Surface * getTextureSurface() {
-            return this->textureSurface;
+        bool isCompressed() {
+            return this->compressedFormat != 0;
         }
-        void setId(const unsigned int & id) {
-            this->id = id;
+        GLenum getCompressedFormat() {
+            return this->compressedFormat;
+        }
+        const std::vector<TextureLevel> & getLevels() {
+            return this->levels;
+        }
+        GLsizei getWidth() {
+            return this->width;
+        }
+        GLsizei getHeight() {
+            return this->height;
+        }
+        // streamable textures may have their finer levels evicted, they are read from the texture cache again
+        bool isStreamable() {
+            return this->streamable;
+        }
+        void setStreamable(const bool streamable) {
+            this->streamable = streamable;
         }
         void setType(const std::string & type) {
             this->type = type;
@@ -176,24 +830,21 @@ class Texture {
         void setPath(const std::string & path) {
             this->path = path;
         }
-    void cleanUp() {
-            glDeleteTextures(1, &this->id);
-        }
-        void load() {
-            if (!this->loaded) {
-                this->textureSurface = IMG_Load(this->path.c_str());
-                if (this->textureSurface != nullptr) {
-                    if (!Texture::findImageFormat(this->textureSurface, &this->imageFormat)) {
-                        std::cerr << "Unsupported Texture Format: " << this->path << std::endl;
-                    } else this->valid = true;
-                } else std::cerr << "Failed to load texture: " << this->path << std::endl;
-                this->loaded = true;
-            }
-        }
-        ~Texture() {
-            if (this->textureSurface != nullptr)
-                SDL_FreeSurface(this->textureSurface);
+        void setTextureSurface(SDL_Surface * surface) {
+            if (this->textureSurface != nullptr) SDL_FreeSurface(this->textureSurface);
+            this->textureSurface = surface;
+            this->valid = Texture::findImageFormat(this->textureSurface, &this->imageFormat);
+            this->width = this->valid ? this->textureSurface->w : 0;
+            this->height = this->valid ? this->textureSurface->h : 0;
+            this->bytesPerPixel = this->valid ? this->textureSurface->format->BytesPerPixel : 0;
+            this->streamable = false;
+            this->loaded = true;
         }
+        void load();
+        size_t getPixelSize(const GLint level);
+        bool readPixels(const GLint level, unsigned char * destination, const size_t size);
+        void releasePixels();
+        ~Texture();
         static bool findImageFormat(SDL_Surface * surface, GLenum * format) {
             if (surface == nullptr || format == nullptr) return false;
 
@@ -211,23 +862,469 @@ class Texture {
         }
 };
 
+class MeshOptimizerStatistics {
+public:
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+class MeshOptimizer final {
+    private:
+        static std::vector<unsigned int> optimizeVertexCache(
+                std::vector<unsigned int> & indices, const size_t numberOfVertices, std::vector<size_t> & clusters);
+        static void optimizeOverdraw(
+                std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices, const std::vector<size_t> & clusters);
+        static std::vector<unsigned int> optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices);
+    public:
+        static const unsigned int CACHE_SIZE = 16;
+
+        static MeshOptimizerStatistics analyze(const std::vector<unsigned int> & indices, const size_t numberOfVertices);
+        static void optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::string & name);
+        // remap holds the new index of every original vertex, UINT_MAX for unused ones
+        static void optimize(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, const std::string & name,
+                std::vector<unsigned int> & remap);
+        // reorders triangles only, for index lists sharing already optimized vertices
+        static void optimizeIndices(std::vector<unsigned int> & indices, const std::vector<Vertex> & vertices);
+};
+
+// a simplified index list into the vertices of the full detail mesh
+class MeshLod {
+public:
+    std::vector<unsigned int> indices;
+    // largest distance from the original surface, in model units
+    float error = 0.0f;
+    size_t offset = 0;
+};
+
+// sum of squared distances to a set of planes, weighted by triangle area
+class Quadric {
+public:
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0, b2 = 0.0, bc = 0.0, bd = 0.0, c2 = 0.0, cd = 0.0, d2 = 0.0;
+    double weight = 0.0;
+
+    Quadric() {};
+    Quadric(const glm::vec3 & normal, const float distance, const float area) {
+        const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        this->a2 = area * a * a; this->ab = area * a * b; this->ac = area * a * c; this->ad = area * a * d;
+        this->b2 = area * b * b; this->bc = area * b * c; this->bd = area * b * d;
+        this->c2 = area * c * c; this->cd = area * c * d;
+        this->d2 = area * d * d;
+        this->weight = area;
+    }
+    Quadric & operator+=(const Quadric & other) {
+        this->a2 += other.a2; this->ab += other.ab; this->ac += other.ac; this->ad += other.ad;
+        this->b2 += other.b2; this->bc += other.bc; this->bd += other.bd;
+        this->c2 += other.c2; this->cd += other.cd;
+        this->d2 += other.d2;
+        this->weight += other.weight;
+        return *this;
+    }
+    // the weighted mean of the squared distances
+    float evaluate(const glm::vec3 & position) const {
+        const double x = position.x, y = position.y, z = position.z;
+        const double error =
+            this->a2 * x * x + 2.0 * this->ab * x * y + 2.0 * this->ac * x * z + 2.0 * this->ad * x +
+            this->b2 * y * y + 2.0 * this->bc * y * z + 2.0 * this->bd * y +
+            this->c2 * z * z + 2.0 * this->cd * z + this->d2;
+        return this->weight > 0.0 ? static_cast<float>(std::max(error, 0.0) / this->weight) : 0.0f;
+    }
+};
+
+class MeshSimplifier final {
+    private:
+        static void weld(const std::vector<Vertex> & vertices, std::vector<unsigned int> & remap, const bool positionOnly);
+        static bool flips(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+                const std::vector<unsigned int> & triangles, const unsigned int from, const unsigned int to);
+    public:
+        static constexpr unsigned int NUMBER_OF_LODS = 4;
+        static constexpr float LOD_RATIO = 0.5f;
+        // allowed error of the first level relative to the mesh extent, doubling with every further level
+        static constexpr float MAX_ERROR = 0.005f;
+        static constexpr size_t MIN_TRIANGLES = 32;
+
+        static std::vector<unsigned int> simplify(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+                const size_t targetIndexCount, const float maxError, float & error);
+        static std::vector<MeshLod> generateLods(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+                const std::string & name);
+};
+
+// same size textures share one GL_TEXTURE_2D_ARRAY, so draws only differ in the layer index
+class TextureArray {
+    private:
+        GLuint id = 0;
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLenum compressedFormat = 0;
+        GLint levels = 1;
+        bool streamable = false;
+        // textures remove themselves when destroyed, leaving the layer to be reused
+        std::vector<Texture *> layers;
+        std::vector<GLint> pendingLayers;
+        bool dirty = false;
+        // uncompressed layers only upload the base level, the chain is generated once per frame for all of them
+        bool mipmapsOutdated = false;
+
+        // storage is allocated for capacity layers so that adding layers rarely re-specifies the array
+        GLsizei capacity = 0;
+        unsigned int generation = 0;
+
+        GLint residentLevel = 0;
+        GLint requestedLevel = 0;
+        unsigned long lastUsed = 0;
+        bool streaming = false;
+
+        void upload();
+        void setSampling();
+        void bindForUpdate();
+        void queueLayer(const GLint layer);
+    public:
+        TextureArray(const TextureArray&) = delete;
+        TextureArray& operator=(const TextureArray&) = delete;
+
+        TextureArray(const GLsizei width, const GLsizei height, const GLenum compressedFormat, const GLint levels, const bool streamable);
+        GLint addLayer(Texture * texture);
+        void removeLayer(const GLint layer);
+        void detachLayers();
+        void invalidate();
+        bool isDirty() {
+            return this->dirty;
+        }
+        bool isStreamable() {
+            return this->streamable;
+        }
+        void setStreamable(const bool streamable) {
+            this->streamable = streamable;
+        }
+        bool isStreaming() {
+            return this->streaming;
+        }
+        void setStreaming(const bool streaming) {
+            this->streaming = streaming;
+        }
+        unsigned int getGeneration() {
+            return this->generation;
+        }
+        GLint getLevels() {
+            return this->levels;
+        }
+        GLint getResidentLevel() {
+            return this->residentLevel;
+        }
+        GLint getRequestedLevel() {
+            return this->requestedLevel;
+        }
+        unsigned long getLastUsed() {
+            return this->lastUsed;
+        }
+        GLsizei getWidth() {
+            return this->width;
+        }
+        GLsizei getHeight() {
+            return this->height;
+        }
+        std::vector<std::shared_ptr<Texture>> getTextures();
+        size_t getLayerSize(const GLint level);
+        size_t getLevelSize(const GLint level);
+        size_t getResidentSize();
+        void request(const GLint level, const unsigned long frame);
+        void allocateLevel(const GLint level);
+        void uploadLayer(const GLint level, const GLint layer, const void * data);
+        void releaseLevel(const GLint level);
+        void setResidentLevel(const GLint level);
+        void evictLevel();
+        void generateMipmaps();
+        GLuint getId();
+        void cleanUp();
+};
+
+class TextureArrays final {
+    private:
+        static TextureArrays * singleton;
+        std::map<std::string, TextureArray *> ARRAYS;
+        GLuint boundArrays[MaterialPalette::TEXTURE_UNIT] = { 0 };
+        TextureArrays() {};
+    public:
+        // uploads bind here so that no unit used for drawing changes behind the binding cache
+        static const GLint UPDATE_UNIT = MaterialPalette::TEXTURE_UNIT - 1;
+
+        ~TextureArrays();
+        static TextureArrays * instance() {
+            if (TextureArrays::singleton == nullptr) TextureArrays::singleton = new TextureArrays();
+            return TextureArrays::singleton;
+        }
+        void add(std::shared_ptr<Texture> texture);
+        void bind(const GLint unit, TextureArray * array);
+        void bindForUpdate(const GLenum target, const GLuint id);
+        std::vector<TextureArray *> getArrays();
+        // after the uploads of a frame have been submitted
+        void generateMipmaps();
+        void invalidate();
+};
+
+// hands out one shared texture per image and type, so every image is decoded and uploaded once
+class TextureRegistry final {
+    private:
+        static TextureRegistry * singleton;
+        std::map<std::string, std::weak_ptr<Texture>> TEXTURES;
+        TextureRegistry() {};
+    public:
+        ~TextureRegistry();
+        static TextureRegistry * instance() {
+            if (TextureRegistry::singleton == nullptr) TextureRegistry::singleton = new TextureRegistry();
+            return TextureRegistry::singleton;
+        }
+        std::shared_ptr<Texture> getTexture(const std::string & path, const std::string & type);
+};
+
+class TextureUpload {
+    public:
+        size_t size = 0;
+        // runs on a worker thread, writing size bytes into the mapped pixel buffer
+        std::function<bool(unsigned char * destination)> fill;
+        // runs on the GL thread with the pixel buffer bound to GL_PIXEL_UNPACK_BUFFER, pixel data is at offset 0
+        std::function<void(const bool filled)> submit;
+
+        GLuint buffer = 0;
+        unsigned char * destination = nullptr;
+        bool filled = false;
+};
+
+/*
+ * Texture data is written into mapped pixel buffer objects by worker threads.
+ * The GL thread submits the filled buffers to their textures, no more than budget bytes per frame.
+ */
+class TextureUploader final {
+    private:
+        static TextureUploader * singleton;
+
+        std::vector<std::thread> workers;
+        std::mutex uploadsMutex;
+        std::condition_variable uploadsAvailable;
+        std::deque<TextureUpload *> queuedUploads;
+        std::deque<TextureUpload *> mappedUploads;
+        std::deque<TextureUpload *> filledUploads;
+        bool running = true;
+
+        std::vector<GLuint> freeBuffers;
+        size_t mappedSize = 0;
+        size_t budget = TextureUploader::DEFAULT_BUDGET;
+
+        TextureUploader() {};
+        void work();
+        void map(TextureUpload * upload);
+        void unmap(TextureUpload * upload);
+    public:
+        static constexpr size_t DEFAULT_BUDGET = 8 * 1024 * 1024;
+        static const unsigned int MAPPED_FRAMES = 4;
+        static const unsigned int NUMBER_OF_WORKERS = 2;
+
+        TextureUploader(const TextureUploader&) = delete;
+        TextureUploader& operator=(const TextureUploader&) = delete;
+        ~TextureUploader();
+
+        static TextureUploader * instance() {
+            if (TextureUploader::singleton == nullptr) TextureUploader::singleton = new TextureUploader();
+            return TextureUploader::singleton;
+        }
+        static bool copySurface(SDL_Surface * surface, unsigned char * destination);
+
+        void setBudget(const size_t budget) {
+            this->budget = budget;
+        }
+        size_t getBudget() {
+            return this->budget;
+        }
+        void queue(const size_t size, std::function<bool(unsigned char *)> fill, std::function<void(const bool)> submit);
+        void update();
+        // blocks until everything queued has been submitted, for loading outside of the frame loop
+        void flush();
+};
+
+class TextureStreamingJob {
+    public:
+        TextureArray * array = nullptr;
+        GLint level = 0;
+        unsigned int generation = 0;
+        size_t remainingLayers = 0;
+        bool failed = false;
+};
+
+/*
+ * Streamable texture arrays start out with their coarse levels only. Finer levels are requested by screen space size
+ * while rendering, read from the texture cache straight into pixel buffers by the TextureUploader workers
+ * and become visible one level at a time once all layers have arrived.
+ * Once the budget is exceeded the finest levels of the least recently used arrays are evicted.
+ */
+class TextureStreamer final {
+    private:
+        static TextureStreamer * singleton;
+
+        size_t budget = TextureStreamer::DEFAULT_BUDGET;
+        unsigned long frame = 1;
+        GLint viewportHeight = DEFAULT_HEIGHT;
+
+        TextureStreamer() {};
+        void stream(TextureArray * array, const GLint level);
+        void submit(std::shared_ptr<TextureStreamingJob> job, const GLint layer, const bool filled);
+    public:
+        static constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+        static const GLsizei RESIDENT_SIZE = 64;
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+        ~TextureStreamer();
+
+        static TextureStreamer * instance() {
+            if (TextureStreamer::singleton == nullptr) TextureStreamer::singleton = new TextureStreamer();
+            return TextureStreamer::singleton;
+        }
+        static GLint getResidentLevel(const GLsizei width, const GLsizei height, const GLint levels);
+
+        void setBudget(const size_t budget) {
+            this->budget = budget;
+        }
+        size_t getBudget() {
+            return this->budget;
+        }
+        GLint getViewportHeight() {
+            return this->viewportHeight;
+        }
+        void request(Texture * texture, const float projectedSize);
+        // uploads all layers of the array down to the finest level right away
+        void makeResident(TextureArray * array);
+        void update();
+};
+
+class RenderPassQueries {
+    public:
+        static const unsigned int QUERY_FRAMES = 4;
+
+        GLuint queries[QUERY_FRAMES] = { 0, 0, 0, 0 };
+        bool issued[QUERY_FRAMES] = { false, false, false, false };
+        GLuint samplesPassed = 0;
+};
+
+/*
+ * Counts the samples each named pass writes with occlusion queries, results are read back
+ * RenderPassQueries::QUERY_FRAMES frames late so that asking for them does not stall the pipeline
+ */
+class RenderStatistics final {
+    private:
+        static RenderStatistics * singleton;
+
+        std::map<std::string, RenderPassQueries> PASSES;
+        std::string activePass = "";
+        unsigned long frame = 0;
+        GLint viewportPixels = DEFAULT_WIDTH * DEFAULT_HEIGHT;
+
+        RenderStatistics() {};
+    public:
+        RenderStatistics(const RenderStatistics&) = delete;
+        RenderStatistics& operator=(const RenderStatistics&) = delete;
+        ~RenderStatistics();
+
+        static RenderStatistics * instance() {
+            if (RenderStatistics::singleton == nullptr) RenderStatistics::singleton = new RenderStatistics();
+            return RenderStatistics::singleton;
+        }
+
+        void begin(const std::string & pass);
+        void end();
+        void update();
+        GLuint getSamplesPassed(const std::string & pass);
+        float getOverdraw(const std::string & pass);
+};
+
+/*
+ * Positions and normals of every vertex in every frame of a mesh's clips, in one texture buffer.
+ * The vertex shader looks them up by gl_VertexID and blends between neighbouring frames
+ */
+class VertexAnimation final {
+    private:
+        GLuint buffer = 0, texture = 0;
+        size_t numberOfVertices = 0;
+        size_t numberOfFrames = 0;
+        // position and normal per vertex per frame
+        std::vector<glm::vec4> texels;
+        // first frame, number of frames and frames per second
+        std::vector<glm::vec3> clips;
+        bool dirty = false;
+
+        void upload();
+    public:
+        static const GLint TEXTURE_UNIT = 16;
+        static const int MAX_CLIPS = 8;
+        static constexpr float BAKE_RATE = 30.0f;
+
+        VertexAnimation(const size_t numberOfVertices);
+        VertexAnimation(const VertexAnimation&) = delete;
+        VertexAnimation& operator=(const VertexAnimation&) = delete;
+        ~VertexAnimation();
+
+        int addClip(const std::vector<std::vector<Vertex>> & frames, const float framesPerSecond = VertexAnimation::BAKE_RATE);
+        size_t getNumberOfClips() {
+            return this->clips.size();
+        };
+        void bind(Shader * shader);
+        void cleanUp();
+};
+
 class Mesh {
     private:
         GLuint VAO = 0, VBO = 0, EBO = 0;
-        GLuint MODEL_MATRIX = 0, MATERIALS = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        GLuint INSTANCE_TRANSFORMS = 0, MATERIALS = 0, ANIMATIONS = 0;
 
-        std::vector<glm::mat4> modelMatrices;
-        std::vector<Material> materials;
+        std::vector<InstanceTransform> instanceTransforms;
+        std::vector<GLushort> materialIndices;
+        std::vector<InstanceAnimation> instanceAnimations;
+        std::shared_ptr<VertexAnimation> animation;
+        bool instancesChanged = false;
+        bool lodsEnabled = true;
 
-        bool modelMatricesEnabled = false;
+        // indices of the levels follow the full detail ones in the element buffer
+        std::vector<MeshLod> lods;
+        // the level every instance was drawn at, kept for the hysteresis
+        std::vector<unsigned int> instanceLods;
+        std::vector<GLsizei> lodInstanceCounts;
+
+        bool instanceTransformsEnabled = false;
         bool materialsEnabled = false;
+        bool animationsEnabled = false;
         bool useNormalsTexture = true;
+        bool impostorFade = false;
+        bool quantizePositions = true;
+        // the material opacity, below 1 the mesh is drawn in the transparency pass. Texture alpha is no coverage
+        float opacity = 1.0f;
+        bool translucent = false;
+        VertexBounds bounds;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
 
         std::vector<std::shared_ptr<Texture>> textures;
+        // one HAS_<TYPE> per bound texture, the program variant is looked up once per base program
+        std::vector<std::string> shaderDefines;
+        Shader * variantBase = nullptr;
+        Shader * variant = nullptr;
+
+        template <typename V>
+        void uploadVertices();
+        float calculateProjectedSize();
+        float calculateProjectedSize(const InstanceTransform & instanceTransform, const glm::vec3 & eye, const float focalLength);
+        void updateShaderDefines();
+        void pointInstanceAttributes(const size_t firstInstance);
+        void updateInstances();
+        unsigned int getLod(const float projectedSize);
     public:
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
 
+        // on screen diameter in pixels below which the first simplified level is drawn, halving for every further level
+        static constexpr float LOD_SCREEN_SIZE = 256.0f;
+        static constexpr float LOD_HYSTERESIS = 0.15f;
+
+        static GLint getTextureUnit(const std::string & type);
+
         Mesh() {};
         Mesh(std::vector<Vertex> & vertices, std::vector<unsigned int> & indices, std::vector<std::shared_ptr<Texture>> & textures) {
             this->vertices = vertices;
@@ -235,11 +1332,58 @@ class Mesh {
             this->textures = textures;
         }
         void init();
-        void setModelMatrices(std::vector<glm::mat4> & modelMatrices);
-        void setMaterials(std::vector<Material> & materials);
-        void render(Shader * shader);
+        void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms);
+        void setMaterialIndices(std::vector<GLushort> & materialIndices);
+        void setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations);
+        // the depth pre-pass only needs positions, it neither binds nor requests textures
+        void render(Shader * shader, const bool withTextures = true);
         void setUseNormalsTexture(bool useNormalsTexture) {
           this->useNormalsTexture = useNormalsTexture;
+          this->updateShaderDefines();
+        };
+        void setQuantizePositions(bool quantizePositions) {
+          this->quantizePositions = quantizePositions;
+        };
+        void setLods(const std::vector<MeshLod> & lods) {
+          this->lods = lods;
+        };
+        // dithers instances out towards the end of the cross fade to an impostor
+        void setImpostorFade(bool impostorFade) {
+          this->impostorFade = impostorFade;
+          this->updateShaderDefines();
+        };
+        void setAnimation(std::shared_ptr<VertexAnimation> animation) {
+          this->animation = animation;
+          this->updateShaderDefines();
+        };
+        std::shared_ptr<VertexAnimation> getAnimation() {
+          return this->animation;
+        };
+        void setOpacity(const float opacity) {
+          this->opacity = glm::clamp(opacity, 0.0f, 1.0f);
+          this->updateShaderDefines();
+        };
+        float getOpacity() {
+          return this->opacity;
+        };
+        // the built-in program compiles no variants and has no transparency outputs, its meshes stay opaque
+        bool isTranslucent(Shader * shader) {
+          return this->translucent && shader != nullptr && !shader->getFileName().empty();
+        };
+        void setLodsEnabled(bool lodsEnabled) {
+          this->lodsEnabled = lodsEnabled;
+          this->instancesChanged = true;
+        };
+        bool isUsingNormalsTexture() {
+          return this->useNormalsTexture;
+        };
+        void addTexture(std::shared_ptr<Texture> texture) {
+          this->textures.push_back(texture);
+          this->updateShaderDefines();
+        };
+        Shader * selectShader(Shader * shader);
+        std::vector<std::shared_ptr<Texture>> & getTextures() {
+          return this->textures;
         };
 
         void cleanUp();
@@ -248,8 +1392,13 @@ class Mesh {
 class Renderable {
     protected:
         bool initialized = false;
-        Shader * shader = new Shader();
-        Material material;
+        bool staticRenderable = false;
+        Shader * shader = nullptr;
+        bool usesDefaultShader = false;
+        GLushort materialIndex = 0;
+        InstanceAnimation animation;
+        // the shading pass runs after a depth pre-pass that already laid down the opaque meshes
+        bool depthPrePassed = false;
 
         glm::vec3 position = glm::vec3(0.0f);
         glm::vec3 rotation = glm::vec3(0.0f);
@@ -257,13 +1406,38 @@ class Renderable {
     public:
         Renderable(const Renderable&) = delete;
         Renderable& operator=(const Renderable&) = delete;
-        Renderable(Renderable&&) noexcept = default;
-        Renderable& operator=(Renderable&&) noexcept = default;
+        Renderable(Renderable && other) noexcept {
+            *this = std::move(other);
+        };
+        // the reference on the default program moves along, the source must not release it again
+        Renderable& operator=(Renderable && other) noexcept {
+            if (this == &other) return *this;
+
+            this->releaseDefaultShader();
+
+            this->initialized = other.initialized;
+            this->staticRenderable = other.staticRenderable;
+            this->shader = other.shader;
+            this->usesDefaultShader = other.usesDefaultShader;
+            this->materialIndex = other.materialIndex;
+            this->animation = other.animation;
+            this->depthPrePassed = other.depthPrePassed;
+            this->position = other.position;
+            this->rotation = other.rotation;
+            this->scaleFactor = other.scaleFactor;
+
+            other.shader = nullptr;
+            other.usesDefaultShader = false;
+
+            return *this;
+        };
 
         Renderable() {};
         virtual std::string getRenderableID() = 0;
-        virtual void setMaterials(std::vector<Material> & materials) = 0;
-        virtual void setModelMatrices(std::vector<glm::mat4> & modelMatrices) = 0;
+        virtual void setMaterialIndices(std::vector<GLushort> & materialIndices) = 0;
+        virtual void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) = 0;
+        // only renderables with vertex animated meshes play them
+        virtual void setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations) {};
         std::string generateRendarableID() {
             static std::random_device dev;
             static std::mt19937 rng(dev());
@@ -283,6 +1457,26 @@ class Renderable {
         }
         virtual void cleanUp() = 0;
         virtual void render() = 0;
+        virtual std::vector<Mesh *> getMeshes() {
+            return std::vector<Mesh *>();
+        };
+        // draws the translucent meshes, expects the transparency pass to have begun
+        virtual void renderTranslucent() {};
+        // expects the depth program in use and the instance data of the group set, translucent meshes neither occlude nor cast shadows
+        virtual void renderDepth(Shader * shader) {
+            for (auto * mesh : this->getMeshes())
+                if (!mesh->isTranslucent(this->getShader())) mesh->render(shader, false);
+        };
+        bool isStatic() {
+            return this->staticRenderable;
+        }
+        void setDepthPrePassed(const bool depthPrePassed) {
+            this->depthPrePassed = depthPrePassed;
+        }
+        // static renderables get baked into merged geometry and must not move afterwards
+        void setStatic(const bool staticRenderable) {
+            this->staticRenderable = staticRenderable;
+        }
         float getScaleFactor() {
             return this->scaleFactor;
         }
@@ -309,10 +1503,29 @@ class Renderable {
             this->rotation.z = glm::radians(static_cast<float>(z));
         }
         void setColor(const float red, const float green, const float blue, const float alpha) {
-            this->material.diffuseColor = glm::vec4(red, green, blue, alpha);
+            Material material = MaterialPalette::instance()->getMaterial(this->materialIndex);
+            material.diffuseColor = glm::vec4(red, green, blue, alpha);
+            this->materialIndex = MaterialPalette::instance()->addMaterial(material);
         }
         Material getMaterial() {
-            return this->material;
+            return MaterialPalette::instance()->getMaterial(this->materialIndex);
+        }
+        GLushort getMaterialIndex() {
+            return this->materialIndex;
+        }
+        void setAnimation(const GLushort clip, const float timeOffset = 0.0f) {
+            this->animation = InstanceAnimation(clip, timeOffset);
+        }
+        InstanceAnimation getAnimation() {
+            return this->animation;
+        }
+        InstanceTransform calculateInstanceTransform() {
+            const glm::quat rotation =
+                    glm::angleAxis(this->rotation.x, glm::vec3(1, 0, 0)) *
+                    glm::angleAxis(this->rotation.y, glm::vec3(0, 1, 0)) *
+                    glm::angleAxis(this->rotation.z, glm::vec3(0, 0, 1));
+
+            return InstanceTransform(this->position, rotation, this->scaleFactor);
         }
         glm::mat4 calculateTransformationMatrix() {
             glm::mat4 transformation = glm::mat4(1.0f);
@@ -328,19 +1541,33 @@ class Renderable {
             return transformation;
         }
         Shader * getShader() {
+            // the built-in program is only compiled once somebody actually renders with it
+            if (this->shader == nullptr) {
+                this->shader = ShaderRegistry::instance()->acquireDefaultShader();
+                this->usesDefaultShader = true;
+            }
             return this->shader;
         }
         void useShader(Shader * shader) {
             if (shader != nullptr) {
-                if (this->shader != nullptr) delete this->shader;
+                this->releaseDefaultShader();
                 this->shader = shader;
+                // the variants get submitted now and compile while loading carries on
+                for (auto * mesh : this->getMeshes()) mesh->selectShader(shader);
             }
         }
+        void releaseDefaultShader() {
+            if (!this->usesDefaultShader) return;
+
+            ShaderRegistry::instance()->releaseDefaultShader();
+            this->shader = nullptr;
+            this->usesDefaultShader = false;
+        }
         bool hasBeenInitialized() {
             return this->initialized;
         };
         virtual ~Renderable() {
-            if (this->shader != nullptr) delete this->shader;
+            this->releaseDefaultShader();
         }
 };
 
@@ -350,7 +1577,7 @@ class SkyBox {
         unsigned int textureId = 0;
         std::string dir;
         std::string texture;
-        std::vector<std::unique_ptr<Texture>> textures;
+        std::vector<std::shared_ptr<Texture>> textures;
         Shader * shader = nullptr;
         GLuint skyVAO = 0, skyVBO = 0;
     public:
@@ -369,9 +1596,15 @@ class Terrain : Renderable {
     private:
         std::string dir;
         Mesh mesh;
-        unsigned int textureId = 0;
-        std::vector<std::unique_ptr<Texture>> textures;
+        // the grid the mesh was built from, read by the vegetation workers
+        std::vector<float> heights;
+        glm::vec2 origin = glm::vec2(0.0f);
+        float spacing = 1.0f;
+        int size = 0;
+        std::vector<std::shared_ptr<Texture>> textures;
         std::string id = this->generateRendarableID();
+
+        glm::vec3 sampleSurface(const float x, const float z) const;
     public:
         Terrain(const Terrain&) = delete;
         Terrain& operator=(const Terrain&) = delete;
@@ -381,12 +1614,155 @@ class Terrain : Renderable {
         Terrain(const std::string & dir);
         void init();
         void render();
+        void renderDepth(Shader * shader);
         void cleanUp();
-        void setMaterials(std::vector<Material> & materials);
-        void setModelMatrices(std::vector<glm::mat4> & modelMatrices);
+        void setMaterialIndices(std::vector<GLushort> & materialIndices);
+        void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms);
         std::string getRenderableID() {
             return this->id;
         }
+        float getHeight(const float x, const float z) const;
+        glm::vec3 getNormal(const float x, const float z) const;
+        glm::vec2 getMin() const {
+            return this->origin;
+        }
+        glm::vec2 getMax() const {
+            return this->origin + glm::vec2(std::max(this->size - 1, 0) * this->spacing);
+        }
+};
+
+// one kind of plant, scattered no closer than minDistance where the terrain is flat and low enough
+class VegetationKind {
+    public:
+        Mesh mesh;
+        float minDistance = 0.5f;
+        // cosine of the steepest slope it grows on
+        float minUpness = 0.7f;
+        float minHeight = -1000.0f;
+        float maxHeight = 1000.0f;
+        float minScale = 0.8f;
+        float maxScale = 1.2f;
+        // of the mesh, for the cell bounds
+        float height = 1.0f;
+        GLushort materialIndex = 0;
+        std::vector<InstanceTransform> instanceTransforms;
+};
+
+// the instances of one kind after the other, each ordered by rank so that thinning out keeps a prefix
+class VegetationCell {
+    public:
+        std::pair<int, int> coordinates;
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+        std::vector<std::vector<InstanceTransform>> instances;
+        std::vector<std::vector<float>> ranks;
+};
+
+/*
+ * Grass and foliage on the terrain, scattered per cell on worker threads for the cells around the camera
+ * and dropped again once they are left behind, so memory follows the view distance and not the terrain size.
+ * Density falls off with distance by a rank every instance has, the vertex shader shrinks the ones
+ * that drop out and bends all of them in the wind
+ */
+class Vegetation final {
+    private:
+        const Terrain * terrain = nullptr;
+        Shader * shader = nullptr;
+        std::vector<VegetationKind> kinds;
+        glm::vec3 wind = glm::vec3(1.0f, 0.3f, 0.2f);
+        bool initialized = false;
+
+        std::map<std::pair<int, int>, VegetationCell *> cells;
+        // queued or being generated
+        std::set<std::pair<int, int>> pendingCells;
+        // cells and instance counts drawn last, instances are only uploaded again when they change
+        std::vector<size_t> drawn;
+
+        std::vector<std::thread> workers;
+        std::mutex cellsMutex;
+        std::condition_variable cellsQueued;
+        std::deque<std::pair<int, int>> queuedCells;
+        std::deque<VegetationCell *> generatedCells;
+        bool running = true;
+
+        static Mesh createClump(const int leaves, const float width, const float height, const float lean);
+        static std::vector<glm::vec2> sampleDisk(const glm::vec2 & min, const glm::vec2 & max, const float radius, std::mt19937 & random);
+        static float getDistance(const glm::vec3 & min, const glm::vec3 & max, const glm::vec3 & point);
+        void work();
+        VegetationCell * generate(const std::pair<int, int> & coordinates);
+        void stream(const glm::vec3 & eye);
+        void updateInstances(const glm::vec3 & eye);
+    public:
+        static constexpr float CELL_SIZE = 16.0f;
+        // cells are generated up to this distance and dropped a cell beyond it
+        static constexpr float STREAM_DISTANCE = 96.0f;
+        // the density falls from full at the start to nothing at the end
+        static constexpr float FADE_START = 30.0f;
+        static constexpr float FADE_END = 90.0f;
+        static const unsigned int NUMBER_OF_WORKERS = 2;
+
+        Vegetation(const Terrain * terrain, Shader * shader);
+        Vegetation(const Vegetation&) = delete;
+        Vegetation& operator=(const Vegetation&) = delete;
+        ~Vegetation();
+
+        // the same on the CPU and in the vertex shader
+        static float getRank(const glm::vec3 & position);
+        static float getDensity(const float distance);
+
+        void init();
+        // direction in x and z, strength
+        void setWind(const glm::vec2 & direction, const float strength) {
+            this->wind = glm::vec3(glm::length(direction) > 0.0f ? glm::normalize(direction) : glm::vec2(1.0f, 0.0f), strength);
+        }
+        void render();
+        void cleanUp();
+};
+
+/*
+ * A model rendered once from FRAMES x FRAMES directions spread over an octahedron into one atlas
+ * with albedo and coverage in the first layer, object space normals and depth in the second.
+ * Distant instances are drawn as camera facing quads showing the frame closest to their view direction
+ */
+class Impostor final {
+    private:
+        GLuint atlas = 0;
+        GLuint vertexArray = 0;
+        GLuint QUAD = 0, INSTANCE_TRANSFORMS = 0, MATERIALS = 0;
+        Shader * shader = nullptr;
+        float distance = 0.0f;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+
+        std::vector<InstanceTransform> instanceTransforms;
+        std::vector<GLushort> materialIndices;
+
+        static glm::vec3 getFrameDirection(const int x, const int y);
+        void createVertexArray();
+    public:
+        static const int FRAMES = 8;
+        static const GLsizei FRAME_SIZE = 128;
+        static const GLint TEXTURE_UNIT = 9;
+        static constexpr float DEFAULT_DISTANCE = 150.0f;
+        // fraction of the distance over which meshes and impostors cross fade
+        static constexpr float FADE_RANGE = 0.1f;
+
+        Impostor(Shader * shader, const float distance);
+        Impostor(const Impostor&) = delete;
+        Impostor& operator=(const Impostor&) = delete;
+        ~Impostor();
+
+        bool bake(const std::vector<Mesh *> & meshes, Shader * bakeShader);
+        void setInstances(std::vector<InstanceTransform> & instanceTransforms, std::vector<GLushort> & materialIndices);
+        // impostors are not part of the depth pre-pass and write their depth in the shading pass
+        void render(const bool depthPrePassed = false);
+        float getFadeStart() {
+            return this->distance;
+        };
+        float getFadeEnd() {
+            return this->distance * (1.0f + Impostor::FADE_RANGE);
+        };
+        void cleanUp();
 };
 
 class Model {
@@ -396,9 +1772,15 @@ class Model {
         std::vector<Mesh> meshes;
         bool loaded = false;
         bool initialized = false;
+        Impostor * impostor = nullptr;
+        // held back until the instances are split between the meshes and the impostor
+        std::vector<GLushort> materialIndices;
+        std::vector<InstanceAnimation> instanceAnimations;
 
         void processNode(const aiNode * node, const aiScene *scene);
         Mesh processMesh(const aiMesh *mesh, const aiScene *scene);
+        std::shared_ptr<VertexAnimation> bakeAnimations(const aiMesh * mesh, const aiScene * scene,
+                const std::vector<Vertex> & vertices, const std::vector<unsigned int> & remap, const size_t numberOfVertices);
         void addTextures(const aiMaterial * mat, const aiTextureType type, const std::string name, std::vector<std::shared_ptr<Texture>> & textures);
         void correctTexturePath(char * path);
     public:
@@ -416,16 +1798,21 @@ class Model {
         Model() {};
         Model(const std::string & dir, const std::string & file);
         void init();
-        void render(Shader * shader);
+        // either the opaque or the translucent meshes, the opaque ones after a depth pre-pass or not
+        void render(Shader * shader, const bool translucent = false, const bool depthPrePassed = false);
         void cleanUp();
         bool hasBeenLoaded() {
             return this->loaded;
         };
+        void createImpostor(const float distance = Impostor::DEFAULT_DISTANCE);
         void addMaterialInstance(const Material & material);
-        void addModelInstance(const glm::mat4 & modelMatrix);
         void useNormalsTexture(const bool flag);
-        void setMaterials(std::vector<Material> & materials);
-        void setModelMatrices(std::vector<glm::mat4> & modelMatrices);
+        // overrides the opacity the materials were imported with
+        void setOpacity(const float opacity);
+        std::vector<Mesh *> getMeshes();
+        void setMaterialIndices(std::vector<GLushort> & materialIndices);
+        void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms);
+        void setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations);
         std::string getPath() {
             return this->file;
         }
@@ -433,12 +1820,10 @@ class Model {
 
 class Image : public Renderable {
     private:
-        unsigned int textureId = 0;
         Mesh mesh;
-        SDL_Surface * image = nullptr;
+        std::shared_ptr<Texture> texture;
         std::string text = "";
         Image() {};
-        ~Image();
         void init();
         std::string id = this->generateRendarableID();
     public:
@@ -451,8 +1836,9 @@ class Image : public Renderable {
         static Image * fromText(std::string fontFile, std::string text, int size);
         void render();
         void cleanUp();
-        void setMaterials(std::vector<Material> & materials);
-        void setModelMatrices(std::vector<glm::mat4> & modelMatrices);
+        void setMaterialIndices(std::vector<GLushort> & materialIndices);
+        void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms);
+        std::vector<Mesh *> getMeshes();
         std::string getRenderableID() {
             return this->id;
         }
@@ -515,6 +1901,7 @@ class Camera final {
         void updateLocation(const SDL_Scancode & direction, const float frameDuration);
         void updateYlocation(const float frameDuration);
         glm::mat4 getViewMatrix();
+        bool isInFrustum(const glm::vec3 & min, const glm::vec3 & max);
         float getFieldOfViewY();
         void setFieldOfViewY(const float fovy);
         static Camera * instance() {
@@ -541,9 +1928,12 @@ class Entity : public Renderable {
         Entity(Model * model);
         Entity(Model * model, Shader * shader);
         void render();
+        void renderTranslucent();
         void cleanUp();
-        void setMaterials(std::vector<Material> & materials);
-        void setModelMatrices(std::vector<glm::mat4> & modelMatrices);
+        std::vector<Mesh *> getMeshes();
+        void setMaterialIndices(std::vector<GLushort> & materialIndices);
+        void setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms);
+        void setInstanceAnimations(std::vector<InstanceAnimation> & instanceAnimations);
         std::string getRenderableID() {
             return this->id;
         }
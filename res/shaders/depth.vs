@@ -0,0 +1,52 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 5) in vec3 instancePosition;
+layout (location = 6) in vec4 instanceRotation;
+layout (location = 7) in float instanceScale;
+layout (location = 10) in uint animationClip;
+layout (location = 11) in float animationOffset;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// quantized positions are relative to the mesh bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// shared by all meshes, so vertex animation is switched on per draw rather than per variant
+uniform bool vertexAnimation;
+uniform samplerBuffer animationFrames;
+uniform vec3 animationClips[8];
+uniform int animationVertices;
+uniform float animationTime;
+
+// the shading pass tests against this depth with GL_LEQUAL, both have to compute the exact same position
+invariant gl_Position;
+
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// has to match the blend in textures.vs
+vec3 animate() {
+	vec3 clip = animationClips[animationClip];
+	float frame = mod((animationTime + animationOffset) * clip.z, clip.y);
+	int first = int(frame);
+	int second = int(mod(float(first + 1), clip.y));
+
+	int firstIndex = ((int(clip.x) + first) * animationVertices + gl_VertexID) * 2;
+	int secondIndex = ((int(clip.x) + second) * animationVertices + gl_VertexID) * 2;
+
+	return mix(texelFetch(animationFrames, firstIndex).xyz, texelFetch(animationFrames, secondIndex).xyz, fract(frame));
+}
+
+void main() {
+	vec4 rotation = normalize(instanceRotation);
+	vec3 meshPosition = positionOffset + position * positionScale;
+	if (vertexAnimation) meshPosition = animate();
+	vec3 pos = instancePosition + instanceScale * rotate(rotation, meshPosition);
+
+    vec4 viewPos = view * vec4(pos, 1.0);
+    gl_Position = projection * viewPos;
+}
@@ -0,0 +1,108 @@
+#version 330 core
+
+in vec3 objectPos;
+flat in vec3 objectEye;
+flat in ivec2 frame;
+flat in vec3 frameDirection;
+flat in vec3 frameRight;
+flat in vec3 frameUp;
+flat in vec4 rotation;
+flat in float scale;
+flat in vec3 worldCenter;
+flat in float fade;
+
+flat in vec4 emissiveColor;
+flat in vec4 ambientColor;
+flat in vec4 diffuseColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 ambientLight;
+uniform vec3 sunDirection;
+uniform vec3 sunLightColor;
+
+uniform float impostorRadius;
+uniform int impostorFrames;
+// albedo with coverage in layer 0, object space normal with the orthographic depth in layer 1
+uniform sampler2DArray impostorAtlas;
+
+// sun shadow cascades, each with its light space matrix and the view depth it reaches to
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform float shadowSplits[4];
+
+#ifdef DEFERRED
+// the G-buffer, lit once per pixel afterwards
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gSpecular;
+layout (location = 3) out vec4 gAmbient;
+#else
+out vec4 fragColor;
+#endif
+
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// 4x4 ordered dither, the meshes keep the pixels below the fade and the impostor the others
+float ditherThreshold() {
+	const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+// 1 where the sun reaches the surface, beyond the last cascade everything is lit
+float calculateShadow(vec3 position, float depth) {
+	if (depth > shadowSplits[3]) return 1.0;
+
+	int cascade = 0;
+	while (cascade < 3 && depth > shadowSplits[cascade]) cascade++;
+
+	vec4 shadowPos = shadowMatrices[cascade] * vec4(position, 1.0);
+	vec3 coords = shadowPos.xyz / shadowPos.w * 0.5 + 0.5;
+	return texture(shadowMap, vec4(coords.xy, cascade, coords.z));
+}
+
+void main() {
+	if (ditherThreshold() >= fade) discard;
+
+	// where the view ray through the quad meets the plane the frame was baked on
+	vec3 ray = objectPos - objectEye;
+	float facing = dot(ray, frameDirection);
+	if (abs(facing) < 0.00001) discard;
+	vec3 hit = objectEye - ray * dot(objectEye, frameDirection) / facing;
+
+	vec2 local = vec2(dot(hit, frameRight), dot(hit, frameUp)) / impostorRadius * 0.5 + 0.5;
+	if (any(lessThan(local, vec2(0.0))) || any(greaterThan(local, vec2(1.0)))) discard;
+
+	vec2 uv = (vec2(frame) + local) / float(impostorFrames);
+	vec4 albedo = texture(impostorAtlas, vec3(uv, 0.0));
+	if (albedo.a < 0.5) discard;
+	vec4 normalDepth = texture(impostorAtlas, vec3(uv, 1.0));
+
+	// the baked depth runs from the near side of the bounding sphere to the far side
+	vec3 surface = hit + frameDirection * impostorRadius * (1.0 - 2.0 * normalDepth.a);
+	vec3 worldPos = worldCenter + scale * rotate(rotation, surface);
+	vec4 viewPos = view * vec4(worldPos, 1.0);
+	vec4 clipPos = projection * viewPos;
+	gl_FragDepth = clipPos.z / clipPos.w * 0.5 + 0.5;
+
+	vec3 normal = normalize(rotate(rotation, normalDepth.xyz * 2.0 - 1.0));
+	vec4 surfaceAlbedo = vec4(albedo.rgb, 1.0) * diffuseColor;
+	vec4 emission = emissiveColor * vec4(ambientLight, 1.0);
+	vec4 ambience = vec4(ambientLight, 1.0) * ambientColor;
+
+#ifdef DEFERRED
+	gAlbedo = surfaceAlbedo;
+	gNormal = vec4(normal, 1.0);
+	gSpecular = vec4(0.0);
+	gAmbient = emission + ambience;
+#else
+	// far enough away for the sun alone, without specular highlights
+	float shadow = calculateShadow(worldPos, -viewPos.z);
+	float diff = max(dot(normal, normalize(sunDirection - worldPos)) * shadow, 0.1);
+
+	fragColor = emission + ambience + vec4(diff * sunLightColor, 1.0) * surfaceAlbedo;
+#endif
+}
@@ -0,0 +1,90 @@
+#version 330 core
+
+layout (location = 0) in vec2 corner;
+layout (location = 5) in vec3 instancePosition;
+layout (location = 6) in vec4 instanceRotation;
+layout (location = 7) in float instanceScale;
+layout (location = 9) in uint materialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 eyePosition;
+
+uniform samplerBuffer materials;
+
+// bounding sphere of the model the atlas was baked from, in object space
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform int impostorFrames;
+// distances at which the cross fade from the meshes starts and ends
+uniform vec2 impostorFade;
+
+// relative to the bounding sphere center, unscaled
+out vec3 objectPos;
+flat out vec3 objectEye;
+flat out ivec2 frame;
+flat out vec3 frameDirection;
+flat out vec3 frameRight;
+flat out vec3 frameUp;
+flat out vec4 rotation;
+flat out float scale;
+flat out vec3 worldCenter;
+flat out float fade;
+
+flat out vec4 emissiveColor;
+flat out vec4 ambientColor;
+flat out vec4 diffuseColor;
+
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+float signNotZero(float v) {
+	return v >= 0.0 ? 1.0 : -1.0;
+}
+
+// octahedral mapping with +y in the center, Impostor::getFrameDirection decodes the same way
+vec2 encodeDirection(vec3 direction) {
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	vec2 uv = direction.xz;
+	if (direction.y < 0.0) uv = vec2((1.0 - abs(uv.y)) * signNotZero(uv.x), (1.0 - abs(uv.x)) * signNotZero(uv.y));
+	return uv;
+}
+
+vec3 decodeDirection(vec2 uv) {
+	vec3 direction = vec3(uv.x, 1.0 - abs(uv.x) - abs(uv.y), uv.y);
+	if (direction.y < 0.0)
+		direction.xz = vec2((1.0 - abs(direction.z)) * signNotZero(direction.x), (1.0 - abs(direction.x)) * signNotZero(direction.z));
+	return normalize(direction);
+}
+
+void main() {
+	rotation = normalize(instanceRotation);
+	scale = instanceScale;
+	vec4 inverseRotation = vec4(-rotation.xyz, rotation.w);
+	worldCenter = instancePosition + instanceScale * rotate(rotation, impostorCenter);
+
+	// camera facing, the axes of the camera are the rows of the view matrix
+	vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
+	vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+	vec3 pos = worldCenter + (corner.x * cameraRight + corner.y * cameraUp) * impostorRadius * instanceScale;
+	gl_Position = projection * view * vec4(pos, 1.0);
+
+	objectPos = rotate(inverseRotation, (pos - worldCenter) / instanceScale);
+	objectEye = rotate(inverseRotation, (eyePosition - worldCenter) / instanceScale);
+
+	frame = clamp(ivec2((encodeDirection(normalize(objectEye)) * 0.5 + 0.5) * float(impostorFrames)), ivec2(0), ivec2(impostorFrames - 1));
+	frameDirection = decodeDirection((vec2(frame) + 0.5) / float(impostorFrames) * 2.0 - 1.0);
+	// the axes of the orthographic camera the frame was baked with
+	vec3 up = abs(frameDirection.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	frameRight = normalize(cross(-frameDirection, up));
+	frameUp = cross(frameRight, -frameDirection);
+
+	fade = impostorFade.y > impostorFade.x ?
+		clamp((distance(instancePosition, eyePosition) - impostorFade.x) / (impostorFade.y - impostorFade.x), 0.0, 1.0) : 1.0;
+
+	int materialOffset = int(materialIndex) * 5;
+	emissiveColor = texelFetch(materials, materialOffset);
+	ambientColor = texelFetch(materials, materialOffset + 1);
+	diffuseColor = texelFetch(materials, materialOffset + 2);
+}
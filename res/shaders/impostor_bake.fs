@@ -0,0 +1,25 @@
+#version 330 core
+
+in vec3 norm;
+in vec2 uvCoords;
+
+#ifdef HAS_TEXTURE_DIFFUSE
+uniform sampler2DArray texture_diffuse;
+#endif
+
+// array layers of the ambient, diffuse, specular and normals textures
+uniform int texture_layers[4];
+
+// albedo with coverage, object space normal with the orthographic depth
+layout (location = 0) out vec4 impostorAlbedo;
+layout (location = 1) out vec4 impostorNormal;
+
+void main() {
+	vec4 albedo = vec4(1.0);
+#ifdef HAS_TEXTURE_DIFFUSE
+	albedo = texture(texture_diffuse, vec3(uvCoords, texture_layers[1]));
+#endif
+
+	impostorAlbedo = vec4(albedo.rgb, 1.0);
+	impostorNormal = vec4(normalize(norm) * 0.5 + 0.5, gl_FragCoord.z);
+}
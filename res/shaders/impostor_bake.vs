@@ -0,0 +1,33 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 uvs;
+layout (location = 5) in vec3 instancePosition;
+layout (location = 6) in vec4 instanceRotation;
+layout (location = 7) in float instanceScale;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// quantized positions are relative to the mesh bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+out vec3 norm;
+out vec2 uvCoords;
+
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// baked as one untransformed instance, everything stays in object space
+void main() {
+	vec4 rotation = normalize(instanceRotation);
+	vec3 meshPosition = positionOffset + position * positionScale;
+	vec3 pos = instancePosition + instanceScale * rotate(rotation, meshPosition);
+
+	gl_Position = projection * view * vec4(pos, 1.0);
+	norm = rotate(rotation, normal);
+	uvCoords = uvs;
+}
@@ -0,0 +1,98 @@
+#version 330 core
+
+in vec2 uvCoords;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gAmbient;
+uniform sampler2D gDepth;
+// the part of the G-buffer covered by the viewport
+uniform vec2 uvScale;
+
+uniform mat4 view;
+uniform mat4 inverseViewProjection;
+
+uniform vec3 sunDirection;
+uniform vec3 sunLightColor;
+uniform vec3 eyePosition;
+
+// 3 texels per light: position and radius, color and inner cone cosine, direction and outer cone cosine
+uniform samplerBuffer lights;
+// offset into lightIndices and number of lights per cluster
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileScale;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+uniform int clusterCount[3];
+
+// sun shadow cascades, each with its light space matrix and the view depth it reaches to
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform float shadowSplits[4];
+
+out vec4 fragColor;
+
+// 1 where the sun reaches the surface, beyond the last cascade everything is lit
+float calculateShadow(vec3 position, float depth) {
+	if (depth > shadowSplits[3]) return 1.0;
+
+	int cascade = 0;
+	while (cascade < 3 && depth > shadowSplits[cascade]) cascade++;
+
+	vec4 shadowPos = shadowMatrices[cascade] * vec4(position, 1.0);
+	vec3 coords = shadowPos.xyz / shadowPos.w * 0.5 + 0.5;
+	return texture(shadowMap, vec4(coords.xy, cascade, coords.z));
+}
+
+void main() {
+	vec2 uv = uvCoords * uvScale;
+	float depth = texture(gDepth, uv).r;
+	// nothing was drawn, the sky fills it in later
+	if (depth >= 1.0) discard;
+
+	vec4 worldPos = inverseViewProjection * vec4(vec3(uvCoords, depth) * 2.0 - 1.0, 1.0);
+	vec3 pos = worldPos.xyz / worldPos.w;
+	float viewDepth = -(view * vec4(pos, 1.0)).z;
+
+	vec4 albedo = texture(gAlbedo, uv);
+	vec4 normalShininess = texture(gNormal, uv);
+	vec3 normals = normalize(normalShininess.xyz);
+	float shininess = normalShininess.w;
+	vec4 specularAlbedo = texture(gSpecular, uv);
+
+	vec3 eyeDir = normalize(eyePosition - pos);
+
+	float shadow = calculateShadow(pos, viewDepth);
+
+	vec3 lightDir = normalize(sunDirection - pos);
+	vec3 diffuseLight = max(dot(normals, lightDir) * shadow, 0.1) * sunLightColor;
+	vec3 specularLight = pow(max(dot(normals, normalize(lightDir + eyeDir)), 0.1), shininess) * shadow * sunLightColor;
+
+	ivec3 cluster = ivec3(gl_FragCoord.xy * clusterTileScale, log(max(viewDepth, 0.0001)) * clusterDepthScale + clusterDepthBias);
+	cluster = clamp(cluster, ivec3(0), ivec3(clusterCount[0], clusterCount[1], clusterCount[2]) - 1);
+
+	uvec2 range = texelFetch(lightGrid, (cluster.z * clusterCount[1] + cluster.y) * clusterCount[0] + cluster.x).xy;
+	for (uint i = 0u; i < range.y; i++) {
+		int light = int(texelFetch(lightIndices, int(range.x + i)).r) * 3;
+		vec4 positionRadius = texelFetch(lights, light);
+		vec4 colorInner = texelFetch(lights, light + 1);
+		vec4 directionOuter = texelFetch(lights, light + 2);
+
+		vec3 toLight = positionRadius.xyz - pos;
+		float distanceSquared = dot(toLight, toLight);
+		vec3 pointLightDir = toLight * inversesqrt(max(distanceSquared, 0.0001));
+
+		float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+		falloff *= falloff;
+		// point lights carry -2 as their cone cosines
+		if (directionOuter.w > -1.5) falloff *= smoothstep(directionOuter.w, colorInner.w, dot(-pointLightDir, directionOuter.xyz));
+
+		diffuseLight += max(dot(normals, pointLightDir), 0.0) * falloff * colorInner.rgb;
+		specularLight += pow(max(dot(normals, normalize(pointLightDir + eyeDir)), 0.0), shininess) * falloff * colorInner.rgb;
+	}
+
+	fragColor = texture(gAmbient, uv) + vec4(diffuseLight, 1.0) * albedo + vec4(specularLight, 1.0) * specularAlbedo;
+	gl_FragDepth = depth;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 corner;
+in vec4 color;
+in float viewDepth;
+
+uniform mat4 projection;
+uniform sampler2D sceneDepth;
+uniform bool softFade;
+uniform float softness;
+
+out vec4 fragColor;
+
+void main() {
+	float falloff = 1.0 - dot(corner, corner);
+	if (falloff <= 0.0) discard;
+
+	float alpha = color.a * falloff;
+
+	// fades out as the particle gets close to the geometry behind it instead of cutting into it
+	if (softFade) {
+		float depth = texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r;
+		float sceneDistance = projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+		alpha *= clamp((sceneDistance - viewDepth) / softness, 0.0, 1.0);
+	}
+
+	// premultiplied for additive blending
+	fragColor = vec4(color.rgb * alpha, alpha);
+}
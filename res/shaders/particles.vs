@@ -0,0 +1,50 @@
+#version 330 core
+
+layout (location = 0) in vec4 particlePosition;
+layout (location = 1) in vec4 particleVelocity;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform vec4 emitterSlots[16];
+uniform vec4 emitterStartColors[16];
+uniform vec4 emitterEndColors[16];
+uniform float emitterSizes[16];
+uniform int numberOfEmitters;
+
+out vec2 corner;
+out vec4 color;
+out float viewDepth;
+
+int findEmitter(int slot) {
+	for (int i=0;i<numberOfEmitters;i++) {
+		vec4 slots = emitterSlots[i];
+		if (slots.z > 0.0 && float(slot) >= slots.x && float(slot) < slots.x + slots.y) return i;
+	}
+
+	return -1;
+}
+
+void main() {
+	corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	color = vec4(0.0);
+	viewDepth = 0.0;
+
+	// slots that are free, waiting to be born or just expired are moved out of the clip volume
+	int emitter = findEmitter(gl_InstanceID);
+	float age = particlePosition.w;
+	float lifetime = particleVelocity.w;
+	if (emitter < 0 || lifetime <= 0.0 || age < 0.0 || age >= lifetime) {
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+		return;
+	}
+
+	color = mix(emitterStartColors[emitter], emitterEndColors[emitter], age / lifetime);
+
+	// offset in view space, the quad always faces the camera
+	vec4 viewPos = view * vec4(particlePosition.xyz, 1.0);
+	viewPos.xy += corner * emitterSizes[emitter];
+	viewDepth = -viewPos.z;
+
+	gl_Position = projection * viewPos;
+}
@@ -0,0 +1,5 @@
+#version 330 core
+
+// the simulation runs with the rasterizer discarded, this stage is never reached
+void main() {
+}
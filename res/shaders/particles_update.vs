@@ -0,0 +1,96 @@
+#version 330 core
+
+// xyz and the age in seconds, negative while the slot waits for its turn to be born
+layout (location = 0) in vec4 particlePosition;
+// xyz and the lifetime, zero for a slot that was never spawned into
+layout (location = 1) in vec4 particleVelocity;
+
+// first slot, number of slots, active and particles per second
+uniform vec4 emitterSlots[16];
+// position and spread
+uniform vec4 emitterPositions[16];
+// direction and speed
+uniform vec4 emitterDirections[16];
+// gravity and lifetime
+uniform vec4 emitterGravity[16];
+uniform int numberOfEmitters;
+
+uniform float deltaTime;
+uniform float time;
+
+out vec4 outPosition;
+out vec4 outVelocity;
+
+uint hash(uint x) {
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+float random(inout uint seed) {
+	seed = hash(seed);
+	return float(seed) / 4294967295.0;
+}
+
+int findEmitter(int slot) {
+	for (int i=0;i<numberOfEmitters;i++) {
+		vec4 slots = emitterSlots[i];
+		if (slots.z > 0.0 && float(slot) >= slots.x && float(slot) < slots.x + slots.y) return i;
+	}
+
+	return -1;
+}
+
+// uniformly within the cone around the emitter direction
+vec3 emitDirection(int emitter, inout uint seed) {
+	vec3 direction = emitterDirections[emitter].xyz;
+	float cosTheta = mix(1.0, cos(emitterPositions[emitter].w), random(seed));
+	float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+	float phi = 6.28318530718 * random(seed);
+
+	vec3 helper = abs(direction.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 tangent = normalize(cross(helper, direction));
+	vec3 bitangent = cross(direction, tangent);
+
+	return normalize(direction * cosTheta + (tangent * cos(phi) + bitangent * sin(phi)) * sinTheta);
+}
+
+void main() {
+	outPosition = particlePosition;
+	outVelocity = particleVelocity;
+
+	int emitter = findEmitter(gl_VertexID);
+	if (emitter < 0) {
+		outPosition = vec4(0.0);
+		outVelocity = vec4(0.0);
+		return;
+	}
+
+	vec4 slots = emitterSlots[emitter];
+	float lifetime = emitterGravity[emitter].w;
+
+	// births are staggered over the slots, the emitter streams at its rate from the first frame on
+	if (particleVelocity.w <= 0.0) {
+		outPosition = vec4(emitterPositions[emitter].xyz, -(float(gl_VertexID) - slots.x) / slots.w);
+		outVelocity = vec4(0.0, 0.0, 0.0, lifetime);
+		return;
+	}
+
+	float age = particlePosition.w + deltaTime;
+	outPosition.w = age;
+	if (age < 0.0) return;
+
+	if (particlePosition.w < 0.0 || age >= particleVelocity.w) {
+		uint seed = hash(uint(gl_VertexID)) ^ hash(floatBitsToUint(time));
+
+		outPosition = vec4(emitterPositions[emitter].xyz, mod(age, particleVelocity.w));
+		outVelocity = vec4(emitDirection(emitter, seed) * emitterDirections[emitter].w, lifetime);
+		return;
+	}
+
+	outVelocity.xyz += emitterGravity[emitter].xyz * deltaTime;
+	outPosition.xyz += outVelocity.xyz * deltaTime;
+}
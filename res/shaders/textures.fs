@@ -1,6 +1,9 @@
 #version 330 core
 
 in vec3 pos;
+in vec3 worldPos;
+in float viewDepth;
+in mat3 tangentSpace;
 in vec3 norm;
 
 in vec2 uvCoords;
@@ -14,50 +17,178 @@ in float shininess;
 in vec3 sunPos;
 in vec3 eyePos;
 
+#ifdef IMPOSTOR_FADE
+flat in float fade;
+#endif
+
 uniform vec3 ambientLight;
 uniform vec3 sunLightColor;
 
-uniform sampler2D texture_ambient;
-uniform bool has_texture_ambient;
-uniform sampler2D texture_diffuse;
-uniform bool has_texture_diffuse;
-uniform sampler2D texture_specular;
-uniform bool has_texture_specular;
-uniform sampler2D texture_normals;
-uniform bool has_texture_normals;
+// compiled per set of textures a mesh has, see Mesh::selectShader
+#ifdef HAS_TEXTURE_AMBIENT
+uniform sampler2DArray texture_ambient;
+#endif
+#ifdef HAS_TEXTURE_DIFFUSE
+uniform sampler2DArray texture_diffuse;
+#endif
+#ifdef HAS_TEXTURE_SPECULAR
+uniform sampler2DArray texture_specular;
+#endif
+#ifdef HAS_TEXTURE_NORMALS
+uniform sampler2DArray texture_normals;
+#endif
+
+// array layers of the ambient, diffuse, specular and normals textures
+uniform int texture_layers[4];
+
+// 3 texels per light: position and radius, color and inner cone cosine, direction and outer cone cosine
+uniform samplerBuffer lights;
+// offset into lightIndices and number of lights per cluster
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileScale;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+uniform int clusterCount[3];
+
+// sun shadow cascades, each with its light space matrix and the view depth it reaches to
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform float shadowSplits[4];
 
+#ifdef TRANSLUCENT
+// material opacity of the mesh, the instance color scales it. The alpha of diffuse textures is no coverage
+uniform float opacity;
+
+// the weighted blended targets of the TransparencyBuffer, translucent surfaces are lit right away on either path
+layout (location = 0) out vec4 accumulation;
+layout (location = 1) out float weight;
+#elif defined(DEFERRED)
+// the G-buffer, lit once per pixel afterwards
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gSpecular;
+layout (location = 3) out vec4 gAmbient;
+#else
 out vec4 fragColor;
+#endif
+
+// 1 where the sun reaches the surface, beyond the last cascade everything is lit
+float calculateShadow(vec3 position, float depth) {
+	if (depth > shadowSplits[3]) return 1.0;
+
+	int cascade = 0;
+	while (cascade < 3 && depth > shadowSplits[cascade]) cascade++;
+
+	vec4 shadowPos = shadowMatrices[cascade] * vec4(position, 1.0);
+	vec3 coords = shadowPos.xyz / shadowPos.w * 0.5 + 0.5;
+	return texture(shadowMap, vec4(coords.xy, cascade, coords.z));
+}
+
+// point and spot lights of the cluster the fragment is in, lit in the space the normals are in
+void addClusterLights(vec3 normals, vec3 eyeDir, inout vec3 diffuseLight, inout vec3 specularLight) {
+	ivec3 cluster = ivec3(gl_FragCoord.xy * clusterTileScale, log(max(viewDepth, 0.0001)) * clusterDepthScale + clusterDepthBias);
+	cluster = clamp(cluster, ivec3(0), ivec3(clusterCount[0], clusterCount[1], clusterCount[2]) - 1);
+
+	uvec2 range = texelFetch(lightGrid, (cluster.z * clusterCount[1] + cluster.y) * clusterCount[0] + cluster.x).xy;
+	for (uint i = 0u; i < range.y; i++) {
+		int light = int(texelFetch(lightIndices, int(range.x + i)).r) * 3;
+		vec4 positionRadius = texelFetch(lights, light);
+		vec4 colorInner = texelFetch(lights, light + 1);
+		vec4 directionOuter = texelFetch(lights, light + 2);
+
+		vec3 toLight = positionRadius.xyz - worldPos;
+		float distanceSquared = dot(toLight, toLight);
+		vec3 worldLightDir = toLight * inversesqrt(max(distanceSquared, 0.0001));
+
+		float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+		falloff *= falloff;
+		// point lights carry -2 as their cone cosines
+		if (directionOuter.w > -1.5) falloff *= smoothstep(directionOuter.w, colorInner.w, dot(-worldLightDir, directionOuter.xyz));
+
+		vec3 lightDir = normalize(tangentSpace * worldLightDir);
+		diffuseLight += max(dot(normals, lightDir), 0.0) * falloff * colorInner.rgb;
+		specularLight += pow(max(dot(normals, normalize(lightDir + eyeDir)), 0.0), shininess) * falloff * colorInner.rgb;
+	}
+}
+
+#ifdef IMPOSTOR_FADE
+// 4x4 ordered dither, the meshes keep the pixels below the fade and the impostor the others
+float ditherThreshold() {
+	const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+#endif
+
+#ifdef TRANSLUCENT
+// near surfaces count for more than far ones behind them, the order they arrive in does not matter
+float translucencyWeight(float alpha) {
+	float distanceFactor = 10.0 / (0.00001 + pow(viewDepth / 5.0, 2.0) + pow(viewDepth / 200.0, 6.0));
+	return alpha * clamp(distanceFactor, 0.01, 3000.0);
+}
+#endif
 
 void main() {
+#ifdef IMPOSTOR_FADE
+	if (ditherThreshold() < fade) discard;
+#endif
+
 	vec3 normals = norm;
-	if (has_texture_normals) {
-		normals = texture(texture_normals, uvCoords).rgb;
-		normals = normalize(normals * 2.0 - 1.0);
-	}
+#ifdef HAS_TEXTURE_NORMALS
+	// BC5 only stores x and y, z is rebuilt
+	vec2 xy = texture(texture_normals, vec3(uvCoords, texture_layers[3])).rg * 2.0 - 1.0;
+	normals = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+#endif
 
 	vec4 emission = emissiveColor * vec4(ambientLight, 1.0);
 
 	vec4 ambience = vec4(ambientLight,1) * ambientColor;
-	if (has_texture_ambient) {
-		ambience *= texture(texture_ambient, uvCoords);
-	}
+#ifdef HAS_TEXTURE_AMBIENT
+	ambience *= texture(texture_ambient, vec3(uvCoords, texture_layers[0]));
+#endif
 
-	vec3 lightDir = normalize(sunPos - pos);
-	float diff = max(dot(normals, lightDir), 0.1);
+	vec4 albedo = diffuseColor;
+#ifdef HAS_TEXTURE_DIFFUSE
+	albedo *= texture(texture_diffuse, vec3(uvCoords, texture_layers[1]));
+#endif
 
-	vec4 diffuse = vec4(diff * sunLightColor, 1.0) * diffuseColor;
-	if (has_texture_diffuse) {
-		diffuse *= texture(texture_diffuse, uvCoords);
-	}
+	vec4 specularAlbedo = specularColor;
+#ifdef HAS_TEXTURE_SPECULAR
+	specularAlbedo *= texture(texture_specular, vec3(uvCoords, texture_layers[2]));
+#endif
 
+#if defined(DEFERRED) && !defined(TRANSLUCENT)
+	// the tangent space matrix is orthonormal, its transpose brings the normals back to world space
+	gAlbedo = albedo;
+	gNormal = vec4(normalize(transpose(tangentSpace) * normals), shininess);
+	gSpecular = specularAlbedo;
+	gAmbient = emission + ambience;
+#else
 	vec3 eyeDir = normalize(eyePos - pos);
-	vec3 halfDir = normalize(lightDir + eyeDir);
+	vec3 clusterDiffuse = vec3(0.0);
+	vec3 clusterSpecular = vec3(0.0);
+	addClusterLights(normals, eyeDir, clusterDiffuse, clusterSpecular);
 
-	float spec = pow(max(dot(normals, halfDir), 0.1), shininess);
-	vec4 specular = vec4(spec * sunLightColor, 1) * specularColor;
-	if (has_texture_specular) {
-		specular *= texture(texture_specular, uvCoords);
-	}
+	float shadow = calculateShadow(worldPos, viewDepth);
+
+	vec3 lightDir = normalize(sunPos - pos);
+	float diff = max(dot(normals, lightDir) * shadow, 0.1);
+	vec4 diffuse = vec4(diff * sunLightColor + clusterDiffuse, 1.0) * albedo;
+
+	vec3 halfDir = normalize(lightDir + eyeDir);
+	float spec = pow(max(dot(normals, halfDir), 0.1), shininess) * shadow;
+	vec4 specular = vec4(spec * sunLightColor + clusterSpecular, 1) * specularAlbedo;
 
-	fragColor = emission + ambience + diffuse + specular;
+	vec4 color = emission + ambience + diffuse + specular;
+#ifdef TRANSLUCENT
+	float alpha = clamp(diffuseColor.a * opacity, 0.0, 1.0);
+	float w = translucencyWeight(alpha);
+	// blended by the TransparencyBuffer: rgb adds up, alpha is multiplied by 1 - alpha
+	accumulation = vec4(color.rgb * alpha * w, alpha);
+	weight = alpha * w;
+#else
+	fragColor = color;
+#endif
+#endif
 }
@@ -3,23 +3,54 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uvs;
-layout (location = 3) in vec3 tangent;
-layout (location = 4) in vec3 bitangent;
-layout (location = 5) in mat4 model;
-layout (location = 9) in vec4 emissiveMaterial;
-layout (location = 10) in vec4 ambientMaterial;
-layout (location = 11) in vec4 diffuseMaterial;
-layout (location = 12) in vec4 specularMaterial;
-layout (location = 13) in float shininessMaterial;
+layout (location = 3) in vec4 tangent;
+layout (location = 5) in vec3 instancePosition;
+layout (location = 6) in vec4 instanceRotation;
+layout (location = 7) in float instanceScale;
+layout (location = 9) in uint materialIndex;
+#ifdef HAS_VERTEX_ANIMATION
+layout (location = 10) in uint animationClip;
+layout (location = 11) in float animationOffset;
+#endif
 
 uniform mat4 view;
 uniform mat4 projection;
 
-uniform bool has_texture_normals;
+uniform samplerBuffer materials;
+
+// quantized positions are relative to the mesh bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 uniform vec3 sunDirection;
 uniform vec3 eyePosition;
 
+#ifdef HAS_VERTEX_ANIMATION
+// position and normal of every vertex for every baked frame, clips are first frame, frame count and frames per second
+uniform samplerBuffer animationFrames;
+uniform vec3 animationClips[8];
+uniform int animationVertices;
+uniform float animationTime;
+#endif
+
+#ifdef VEGETATION
+uniform float time;
+// direction in x and z, strength
+uniform vec3 wind;
+// distances over which the density falls from full to nothing
+uniform vec2 vegetationFade;
+#endif
+
+#ifdef IMPOSTOR_FADE
+// distances at which the cross fade to the impostor starts and ends
+uniform vec2 impostorFade;
+flat out float fade;
+#endif
+
 out vec3 pos;
+out vec3 worldPos;
+out float viewDepth;
+out mat3 tangentSpace;
 out vec3 norm;
 out vec3 sunPos;
 out vec3 eyePos;
@@ -30,36 +61,102 @@ out vec4 diffuseColor;
 out vec4 specularColor;
 out float shininess;
 
+invariant gl_Position;
+
+// scale is uniform, so rotating by the instance quaternion is all the normal matrix does
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+#ifdef HAS_VERTEX_ANIMATION
+// blends the two baked frames around the instance's time, clips loop
+void animate(out vec3 animatedPosition, out vec3 animatedNormal) {
+	vec3 clip = animationClips[animationClip];
+	float frame = mod((animationTime + animationOffset) * clip.z, clip.y);
+	int first = int(frame);
+	int second = int(mod(float(first + 1), clip.y));
+
+	int firstIndex = ((int(clip.x) + first) * animationVertices + gl_VertexID) * 2;
+	int secondIndex = ((int(clip.x) + second) * animationVertices + gl_VertexID) * 2;
+	float blend = fract(frame);
+
+	animatedPosition = mix(texelFetch(animationFrames, firstIndex).xyz, texelFetch(animationFrames, secondIndex).xyz, blend);
+	animatedNormal = mix(texelFetch(animationFrames, firstIndex + 1).xyz, texelFetch(animationFrames, secondIndex + 1).xyz, blend);
+}
+#endif
+
+#ifdef VEGETATION
+// has to match Vegetation::getRank, instances drop out in the order of their rank as the density falls
+uint hash(uint x) {
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+float vegetationRank(vec3 position) {
+	return float(hash(floatBitsToUint(position.x) ^ hash(floatBitsToUint(position.z)))) / 4294967295.0;
+}
+#endif
+
 void main() {
-	pos = vec3(model * vec4(position, 1.0));
+	vec4 rotation = normalize(instanceRotation);
+	vec3 meshPosition = positionOffset + position * positionScale;
+	vec3 meshNormal = normal;
+#ifdef HAS_VERTEX_ANIMATION
+	animate(meshPosition, meshNormal);
+#endif
+#ifdef VEGETATION
+	// the instances about to drop out shrink into the ground rather than pop
+	float density = 1.0 - clamp((distance(instancePosition, eyePosition) - vegetationFade.x) / (vegetationFade.y - vegetationFade.x), 0.0, 1.0);
+	meshPosition *= clamp((density - vegetationRank(instancePosition)) * 20.0, 0.0, 1.0);
+#endif
+	pos = instancePosition + instanceScale * rotate(rotation, meshPosition);
+#ifdef VEGETATION
+	// bends with the square of the height, gusts travel along the wind direction
+	float height = meshPosition.y * instanceScale;
+	float gust = 0.6 + 0.4 * sin(time * 1.7 - dot(instancePosition.xz, wind.xy) * 0.15) + 0.15 * sin(time * 4.3 + instancePosition.x * 0.7);
+	pos.xz += wind.xy * (wind.z * gust * height * height);
+#endif
 
-    gl_Position = projection * view * vec4(pos, 1.0);
+    vec4 viewPos = view * vec4(pos, 1.0);
+    gl_Position = projection * viewPos;
+    worldPos = pos;
+    viewDepth = -viewPos.z;
+    tangentSpace = mat3(1.0);
 
- 	norm = normalize(mat3(transpose(inverse(model))) * normal);
+ 	norm = normalize(rotate(rotation, meshNormal));
 
     uvCoords = uvs;	
-	emissiveColor = emissiveMaterial;
-	ambientColor = ambientMaterial;
-	diffuseColor = diffuseMaterial;
-	specularColor = specularMaterial;
-	shininess = shininessMaterial;
+	int materialOffset = int(materialIndex) * 5;
+	emissiveColor = texelFetch(materials, materialOffset);
+	ambientColor = texelFetch(materials, materialOffset + 1);
+	diffuseColor = texelFetch(materials, materialOffset + 2);
+	specularColor = texelFetch(materials, materialOffset + 3);
+	shininess = texelFetch(materials, materialOffset + 4).x;
 
     eyePos = eyePosition;
     sunPos = sunDirection;	
 
-	if (has_texture_normals) {
-	    mat3 normalMat = mat3(transpose(inverse(model)));
-
-	    vec3 T = normalize(normalMat * tangent);
-	    vec3 N = normalize(normalMat * normal);
-	    vec3 B = normalize(normalMat * bitangent);
-
-	    T = normalize(T - dot(T, N) * N);
-	    if (dot(cross(N, T), B) < 0.0f) T *= -1.0f;
-	    mat3 TBN = transpose(mat3(T, cross(N, T), N));
-	    
-	    pos = TBN * pos;
-	    eyePos = TBN * eyePos;
-	    sunPos = TBN * sunPos;	
-	}
+#ifdef IMPOSTOR_FADE
+	fade = impostorFade.y > impostorFade.x ?
+		clamp((distance(instancePosition, eyePosition) - impostorFade.x) / (impostorFade.y - impostorFade.x), 0.0, 1.0) : 0.0;
+#endif
+
+#ifdef HAS_TEXTURE_NORMALS
+	vec3 T = normalize(rotate(rotation, tangent.xyz));
+	vec3 N = norm;
+
+	T = normalize(T - dot(T, N) * N);
+	// tangent.w carries the bitangent sign
+	if (tangent.w < 0.0f) T *= -1.0f;
+	mat3 TBN = transpose(mat3(T, cross(N, T), N));
+	tangentSpace = TBN;
+
+	pos = TBN * pos;
+	eyePos = TBN * eyePos;
+	sunPos = TBN * sunPos;
+#endif
 }
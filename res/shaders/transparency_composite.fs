@@ -0,0 +1,21 @@
+#version 330 core
+
+// weighted premultiplied color in rgb, the product of the transmittances in alpha
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+
+out vec4 fragColor;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 accumulated = texelFetch(accumulation, pixel, 0);
+
+	// revealage, what is left of the scene behind all translucent surfaces
+	float revealage = accumulated.a;
+	if (revealage >= 1.0) discard;
+
+	float weight = texelFetch(weights, pixel, 0).r;
+
+	// blended as scene * revealage + average * (1 - revealage)
+	fragColor = vec4(accumulated.rgb / max(weight, 0.00001), revealage);
+}
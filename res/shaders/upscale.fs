@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 uvCoords;
+
+uniform sampler2D scene;
+// the rendered part of the scene texture
+uniform vec2 uvScale;
+uniform vec2 uvMax;
+uniform vec2 texelSize;
+uniform float sharpness;
+
+out vec4 fragColor;
+
+void main() {
+	vec2 uv = min(uvCoords * uvScale, uvMax);
+
+	vec3 center = texture(scene, uv).rgb;
+	vec3 north = texture(scene, min(uv + vec2(0.0, texelSize.y), uvMax)).rgb;
+	vec3 south = texture(scene, uv - vec2(0.0, texelSize.y)).rgb;
+	vec3 east = texture(scene, min(uv + vec2(texelSize.x, 0.0), uvMax)).rgb;
+	vec3 west = texture(scene, uv - vec2(texelSize.x, 0.0)).rgb;
+
+	// unsharp mask, limited to the range of the neighbourhood so that edges do not ring
+	vec3 sharpened = center + (4.0 * center - north - south - east - west) * sharpness * 0.25;
+	vec3 minimum = min(center, min(min(north, south), min(east, west)));
+	vec3 maximum = max(center, max(max(north, south), max(east, west)));
+
+	fragColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+}
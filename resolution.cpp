@@ -0,0 +1,172 @@
+#include "render.hpp"
+
+DynamicResolution::DynamicResolution(Shader * shader) {
+    this->shader = shader;
+}
+
+void DynamicResolution::setScaleBounds(const float minScale, const float maxScale) {
+    if (minScale <= 0.0f || maxScale < minScale) return;
+
+    this->minScale = minScale;
+    this->maxScale = maxScale;
+    this->scale = glm::clamp(this->scale, minScale, maxScale);
+}
+
+bool DynamicResolution::create(const GLsizei width, const GLsizei height) {
+    this->cleanUp();
+
+    glGenTextures(1, &this->colorTexture);
+    glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &this->depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Scene framebuffer is incomplete: " << status << std::endl;
+        this->cleanUp();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+
+    return true;
+}
+
+/*
+ * GPU time grows with the number of pixels, that is with the square of the scale.
+ * The scale moves one step per frame and only grows with some headroom left so that it settles
+ */
+void DynamicResolution::adjustScale() {
+    const unsigned int slot = this->frame % DynamicResolution::QUERY_FRAMES;
+    if (!this->issued[slot]) return;
+
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(this->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE) return;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(this->queries[slot], GL_QUERY_RESULT, &elapsed);
+    this->issued[slot] = false;
+
+    this->gpuFrameTime = static_cast<float>(elapsed) / 1000000.0f;
+    if (this->gpuFrameTime <= 0.0f) return;
+
+    const float affordableScale = this->scale * glm::sqrt(this->targetFrameTime / this->gpuFrameTime);
+    if (affordableScale < this->scale) this->scale -= DynamicResolution::SCALE_STEP;
+    else if (affordableScale > this->scale + 2.0f * DynamicResolution::SCALE_STEP) this->scale += DynamicResolution::SCALE_STEP;
+
+    this->scale = glm::clamp(this->scale, this->minScale, this->maxScale);
+}
+
+/*
+ * Called once per frame before the scene is rendered, falls back to rendering straight into the window
+ */
+void DynamicResolution::begin(const GLsizei windowWidth, const GLsizei windowHeight) {
+    this->active = false;
+    if (windowWidth <= 0 || windowHeight <= 0 || this->shader == nullptr) return;
+
+    this->windowWidth = windowWidth;
+    this->windowHeight = windowHeight;
+
+    const GLsizei width = static_cast<GLsizei>(glm::ceil(windowWidth * this->maxScale));
+    const GLsizei height = static_cast<GLsizei>(glm::ceil(windowHeight * this->maxScale));
+    if ((width != this->width || height != this->height) && !this->create(width, height)) return;
+
+    this->adjustScale();
+
+    this->renderWidth = glm::clamp(static_cast<GLsizei>(glm::round(windowWidth * this->scale)), 1, this->width);
+    this->renderHeight = glm::clamp(static_cast<GLsizei>(glm::round(windowHeight * this->scale)), 1, this->height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glViewport(0, 0, this->renderWidth, this->renderHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    const unsigned int slot = this->frame % DynamicResolution::QUERY_FRAMES;
+    if (this->queries[slot] == 0) glGenQueries(1, &this->queries[slot]);
+    glBeginQuery(GL_TIME_ELAPSED, this->queries[slot]);
+
+    this->active = true;
+}
+
+void DynamicResolution::end() {
+    if (!this->active) return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    this->issued[this->frame % DynamicResolution::QUERY_FRAMES] = true;
+    this->frame++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, this->windowWidth, this->windowHeight);
+
+    this->shader->use();
+    if (!this->shader->isBeingUsed()) return;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+
+    const glm::vec2 size = glm::vec2(this->width, this->height);
+    this->shader->setInt("scene", 0);
+    this->shader->setVec2("uvScale", glm::vec2(this->renderWidth, this->renderHeight) / size);
+    // keeps the bilinear taps off the texels outside of what was rendered
+    this->shader->setVec2("uvMax", (glm::vec2(this->renderWidth, this->renderHeight) - 0.5f) / size);
+    this->shader->setVec2("texelSize", 1.0f / size);
+    this->shader->setFloat("sharpness", this->renderWidth < this->windowWidth ? this->sharpness : 0.0f);
+
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDisable(GL_DEPTH_TEST);
+
+    if (this->vertexArray == 0) glGenVertexArrays(1, &this->vertexArray);
+    glBindVertexArray(this->vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+
+    this->shader->stopUse();
+}
+
+void DynamicResolution::cleanUp() {
+    if (this->framebuffer != 0) glDeleteFramebuffers(1, &this->framebuffer);
+    if (this->colorTexture != 0) glDeleteTextures(1, &this->colorTexture);
+    if (this->depthBuffer != 0) glDeleteRenderbuffers(1, &this->depthBuffer);
+
+    this->framebuffer = 0;
+    this->colorTexture = 0;
+    this->depthBuffer = 0;
+    this->width = 0;
+    this->height = 0;
+}
+
+DynamicResolution::~DynamicResolution() {
+    this->cleanUp();
+
+    for (auto & query : this->queries)
+        if (query != 0) glDeleteQueries(1, &query);
+    if (this->vertexArray != 0) glDeleteVertexArrays(1, &this->vertexArray);
+}
+
+constexpr float DynamicResolution::DEFAULT_MIN_SCALE;
+constexpr float DynamicResolution::DEFAULT_MAX_SCALE;
+constexpr float DynamicResolution::DEFAULT_TARGET_FRAME_TIME;
+constexpr float DynamicResolution::DEFAULT_SHARPNESS;
+constexpr float DynamicResolution::SCALE_STEP;
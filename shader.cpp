@@ -4,13 +4,34 @@ Shader::Shader() {
     this->init("");
 }
 
+/*
+ * Only submits the program, nothing is queried until it is first needed so that the driver
+ * can compile on its own threads in the meantime, see finish()
+ */
 void Shader::init(const std::string & file_name) {
-    this->m_program = glCreateProgram();
-    this->m_shaders[0] = this->create(GL_VERTEX_SHADER,
+    this->vertexSource = this->addDefines(
             file_name.empty() ? DEFAULT_VERTEX_SHADER : this->read(GL_VERTEX_SHADER));
-    this->m_shaders[1] = this->create(GL_FRAGMENT_SHADER,
+    this->fragmentSource = this->addDefines(
             file_name.empty() ? DEFAULT_FRAGMENT_SHADER : this->read(GL_FRAGMENT_SHADER));
 
+    std::string sources = this->vertexSource + this->fragmentSource;
+    for (auto & varying : this->m_feedbackVaryings) sources.append("|" + varying);
+    this->cacheFile = ShaderRegistry::instance()->getProgramBinaryPath(sources);
+    this->pending = true;
+
+    if (this->loadProgramBinary(this->cacheFile)) {
+        this->fromBinary = true;
+        return;
+    }
+
+    this->submit();
+}
+
+void Shader::submit() {
+    this->m_program = glCreateProgram();
+    this->m_shaders[0] = this->create(GL_VERTEX_SHADER, this->vertexSource);
+    this->m_shaders[1] = this->create(GL_FRAGMENT_SHADER, this->fragmentSource);
+
     for (unsigned int i = 0; i < NUM_SHADERS; i++)
         glAttachShader(this->m_program, this->m_shaders[i]);
 
@@ -18,20 +39,129 @@ void Shader::init(const std::string & file_name) {
     glBindAttribLocation(this->m_program, 1, "normal");
     glBindAttribLocation(this->m_program, 2, "uv");
 
+    if (!this->m_feedbackVaryings.empty()) {
+        std::vector<const GLchar *> varyings;
+        for (auto & varying : this->m_feedbackVaryings) varyings.push_back(varying.c_str());
+        glTransformFeedbackVaryings(this->m_program, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+
+    if (!this->cacheFile.empty()) glProgramParameteri(this->m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
     glLinkProgram(this->m_program);
-    this->checkForError(this->m_program, GL_LINK_STATUS, true,
-            "Error linking shader program");
+    this->fromBinary = false;
+}
 
-    glValidateProgram(m_program);
-    this->checkForError(this->m_program, GL_LINK_STATUS, true,
-            "Invalid shader program");
+// without GL_KHR_parallel_shader_compile there is nothing to poll, finish() simply waits for the driver
+bool Shader::isReady() {
+    if (!this->pending || !ShaderRegistry::instance()->hasParallelCompile()) return true;
+
+    GLint complete = GL_FALSE;
+    glGetProgramiv(this->m_program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+void Shader::finish() {
+    if (!this->pending) return;
+    this->pending = false;
+
+    if (this->fromBinary) {
+        // a driver update invalidates binaries, in which case we compile from source again
+        GLint success = GL_FALSE;
+        glGetProgramiv(this->m_program, GL_LINK_STATUS, &success);
+        if (success == GL_FALSE) {
+            glDeleteProgram(this->m_program);
+            this->submit();
+        }
+    }
+
+    if (!this->fromBinary) {
+        for (unsigned int i = 0; i < NUM_SHADERS; i++)
+            this->checkForError(this->m_shaders[i], GL_COMPILE_STATUS, false,
+                    "Error compiling shader!");
+
+        this->checkForError(this->m_program, GL_LINK_STATUS, true,
+                "Error linking shader program");
+
+        glValidateProgram(m_program);
+        this->checkForError(this->m_program, GL_LINK_STATUS, true,
+                "Invalid shader program");
+
+        if (this->loaded) this->saveProgramBinary(this->cacheFile);
+    }
+
+    this->vertexSource.clear();
+    this->fragmentSource.clear();
 }
 
-Shader::Shader(const std::string & file_name) {
+Shader::Shader(const std::string & file_name, const std::vector<std::string> & defines,
+        const std::vector<std::string> & feedbackVaryings) {
     this->m_file_name = file_name;
+    this->m_defines = defines;
+    this->m_feedbackVaryings = feedbackVaryings;
     this->init(this->m_file_name);
 }
 
+std::string Shader::addDefines(const std::string & source) const {
+    std::vector<std::string> allDefines = ShaderRegistry::instance()->getGlobalDefines();
+    allDefines.insert(allDefines.end(), this->m_defines.begin(), this->m_defines.end());
+    if (allDefines.empty()) return source;
+
+    std::string defines;
+    for (auto & define : allDefines) defines.append("#define " + define + "\n");
+
+    // defines have to follow the #version directive
+    if (source.compare(0, 8, "#version") == 0) {
+        const std::string::size_type endOfVersion = source.find('\n');
+        if (endOfVersion != std::string::npos)
+            return source.substr(0, endOfVersion + 1) + defines + source.substr(endOfVersion + 1);
+    }
+
+    return defines + source;
+}
+
+bool Shader::loadProgramBinary(const std::string & cacheFile) {
+    if (cacheFile.empty()) return false;
+
+    std::ifstream file(cacheFile.c_str(), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+
+    const std::streamsize size = file.tellg();
+    if (size <= static_cast<std::streamsize>(sizeof(GLenum))) return false;
+    file.seekg(0, std::ios::beg);
+
+    GLenum format = 0;
+    std::vector<char> binary(size - sizeof(GLenum));
+    file.read(reinterpret_cast<char *>(&format), sizeof(GLenum));
+    file.read(&binary[0], binary.size());
+    if (!file.good()) return false;
+
+    this->m_program = glCreateProgram();
+    glProgramBinary(this->m_program, format, &binary[0], binary.size());
+
+    return true;
+}
+
+void Shader::saveProgramBinary(const std::string & cacheFile) {
+    if (cacheFile.empty()) return;
+
+    GLint length = 0;
+    glGetProgramiv(this->m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    GLenum format = 0;
+    std::vector<char> binary(length);
+    glGetProgramBinary(this->m_program, length, nullptr, &format, &binary[0]);
+
+    std::ofstream file(cacheFile.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Unable to write shader cache: " << cacheFile << std::endl;
+        return;
+    }
+
+    file.write(reinterpret_cast<const char *>(&format), sizeof(GLenum));
+    file.write(&binary[0], binary.size());
+}
+
 std::string Shader::read(const int type) const {
     std::ifstream file;
     std::string prefixed_file_name = this->m_file_name;
@@ -90,9 +220,6 @@ GLuint Shader::create(const unsigned int type, const std::string text) {
     glShaderSource(shader, 1, p, lengths);
     glCompileShader(shader);
 
-    this->checkForError(shader, GL_COMPILE_STATUS, false,
-            "Error compiling shader!");
-
     return shader;
 }
 
@@ -156,11 +283,27 @@ void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
             GL_FALSE, &mat[0][0]);
 }
 
+void Shader::setSceneUniforms() {
+    this->setMat4("view", Camera::instance()->getViewMatrix());
+    this->setMat4("projection", Camera::instance()->getPerspective());
+    this->setVec3("ambientLight",  World::instance()->getAmbientLight());
+    this->setVec3("sunDirection", World::instance()->getSunDirection());
+    this->setVec3("sunLightColor", World::instance()->getSunLightColor());
+    this->setVec3("eyePosition", Camera::instance()->getPosition());
+    MaterialPalette::instance()->bind(this);
+    LightClusters::instance()->bind(this);
+    ShadowCascades::instance()->bind(this);
+}
+
 GLuint Shader::getId() const {
     return this->m_program;
 }
 
 void Shader::use() {
+    // a program the driver is still building is skipped rather than waited for
+    if (!this->isReady()) return;
+    this->finish();
+
     if (this->loaded && !this->used) {
         glUseProgram(this->m_program);
         this->used = true;
@@ -204,6 +347,7 @@ void Shader::dumpActiveShaderAttributes() {
 
 Shader:: ~Shader() {
     for (unsigned int i = 0; i < NUM_SHADERS; i++) {
+        if (this->m_shaders[i] == 0) continue;
         glDetachShader(this->m_program, this->m_shaders[i]);
         glDeleteShader(this->m_shaders[i]);
     }
@@ -0,0 +1,189 @@
+#include "render.hpp"
+
+bool ShadowCascades::create() {
+    GLuint * textures[2] = { &this->staticDepth, &this->depth };
+    for (auto * texture : textures) {
+        glGenTextures(1, texture);
+        // not on a unit the TextureArrays binding cache tracks for drawing
+        TextureArrays::instance()->bindForUpdate(GL_TEXTURE_2D_ARRAY, *texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, ShadowCascades::SIZE, ShadowCascades::SIZE, ShadowCascades::CASCADES,
+            0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // linear filtering of the comparison gives 2x2 PCF for free
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+
+    // the first update runs with the scene framebuffer already bound
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    glGenFramebuffers(1, &this->drawFramebuffer);
+    glGenFramebuffers(1, &this->readFramebuffer);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->drawFramebuffer);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->depth, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    const GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->readFramebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow map framebuffer is incomplete: " << status << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Every cascade bounds the sphere around its slice of the view frustum, which keeps its size
+ * the same however the camera turns. Its center is snapped in light space so that texels
+ * do not crawl and the static layers stay valid while the camera moves within a snap step
+ */
+void ShadowCascades::fit() {
+    const glm::mat4 projection = Camera::instance()->getPerspective();
+    const glm::mat4 inverseView = glm::inverse(Camera::instance()->getViewMatrix());
+
+    // glm::perspective: [2][2] = -(f+n)/(f-n), [3][2] = -2fn/(f-n)
+    const float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    const float farPlane = std::min(projection[3][2] / (projection[2][2] + 1.0f), this->distance);
+    const float tanX = 1.0f / projection[0][0];
+    const float tanY = 1.0f / projection[1][1];
+
+    const glm::vec3 up = glm::abs(this->lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    this->lightView = glm::lookAt(glm::vec3(0.0f), -this->lightDirection, up);
+
+    float sliceNear = nearPlane;
+    for (int i=0;i<ShadowCascades::CASCADES;i++) {
+        // halfway between uniform and logarithmic splits
+        const float fraction = static_cast<float>(i + 1) / ShadowCascades::CASCADES;
+        const float sliceFar = glm::mix(nearPlane + (farPlane - nearPlane) * fraction, nearPlane * glm::pow(farPlane / nearPlane, fraction), 0.75f);
+
+        // the sphere center lies on the view axis where it is equally far from the near and far corners
+        const float nearSquared = sliceNear * sliceNear * (tanX * tanX + tanY * tanY);
+        const float farSquared = sliceFar * sliceFar * (tanX * tanX + tanY * tanY);
+        const float centerDepth = std::min(
+            (sliceFar * sliceFar + farSquared - sliceNear * sliceNear - nearSquared) / (2.0f * (sliceFar - sliceNear)), sliceFar);
+        const float radius = glm::sqrt(glm::max(
+            (sliceFar - centerDepth) * (sliceFar - centerDepth) + farSquared, (centerDepth - sliceNear) * (centerDepth - sliceNear) + nearSquared));
+
+        const float snap = 2.0f * radius / ShadowCascades::SIZE * ShadowCascades::SNAP_TEXELS;
+        const float extent = radius + snap;
+
+        glm::vec3 center = glm::vec3(this->lightView * inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+        center = glm::floor(center / snap + 0.5f) * snap;
+
+        this->centers[i] = center;
+        this->projections[i] = glm::ortho(center.x - extent, center.x + extent, center.y - extent, center.y + extent,
+            -(center.z + extent + ShadowCascades::CASTER_RANGE), -(center.z - extent));
+        this->splits[i] = sliceFar;
+
+        sliceNear = sliceFar;
+    }
+}
+
+void ShadowCascades::renderLayer(const GLint layer, Shader * depthShader, std::function<void(Shader *)> renderCasters) {
+    depthShader->setMat4("view", this->lightView);
+    depthShader->setMat4("projection", this->projections[layer]);
+
+    renderCasters(depthShader);
+}
+
+/*
+ * Called once per frame on the GL thread before the scene is rendered, with the depth program
+ * and the casters that never move as well as those that might
+ */
+void ShadowCascades::update(Shader * depthShader, std::function<void(Shader *)> renderStatic, std::function<void(Shader *)> renderDynamic) {
+    if (depthShader == nullptr) return;
+
+    if (this->depth == 0 && !this->create()) {
+        this->distance = 0.0f;
+        return;
+    }
+    if (this->distance <= 0.0f) return;
+
+    const glm::vec3 lightDirection = glm::normalize(World::instance()->getSunDirection());
+    if (lightDirection != this->lightDirection) {
+        this->lightDirection = lightDirection;
+        this->invalidate();
+    }
+    this->fit();
+
+    depthShader->use();
+    if (!depthShader->isBeingUsed()) return;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, ShadowCascades::SIZE, ShadowCascades::SIZE);
+
+    // slope scaled bias against acne
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->drawFramebuffer);
+    for (int i=0;i<ShadowCascades::CASCADES;i++) {
+        if (!this->staticValid[i] || this->staticCenters[i] != this->centers[i]) {
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->staticDepth, 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            this->renderLayer(i, depthShader, renderStatic);
+
+            this->staticCenters[i] = this->centers[i];
+            this->staticValid[i] = true;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->readFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->staticDepth, 0, i);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->depth, 0, i);
+        glBlitFramebuffer(0, 0, ShadowCascades::SIZE, ShadowCascades::SIZE, 0, 0, ShadowCascades::SIZE, ShadowCascades::SIZE,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        this->renderLayer(i, depthShader, renderDynamic);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    depthShader->stopUse();
+}
+
+void ShadowCascades::bind(Shader * shader) {
+    if (shader == nullptr) return;
+
+    glActiveTexture(GL_TEXTURE0 + ShadowCascades::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->depth);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader->setInt("shadowMap", ShadowCascades::TEXTURE_UNIT);
+    for (int i=0;i<ShadowCascades::CASCADES;i++) {
+        const std::string index = "[" + std::to_string(i) + "]";
+        shader->setMat4("shadowMatrices" + index, this->projections[i] * this->lightView);
+        // without shadow maps nothing is ever in a cascade
+        shader->setFloat("shadowSplits" + index, this->depth != 0 && this->distance > 0.0f ? this->splits[i] : -1.0f);
+    }
+}
+
+ShadowCascades::~ShadowCascades() {
+    if (this->drawFramebuffer != 0) glDeleteFramebuffers(1, &this->drawFramebuffer);
+    if (this->readFramebuffer != 0) glDeleteFramebuffers(1, &this->readFramebuffer);
+    if (this->staticDepth != 0) glDeleteTextures(1, &this->staticDepth);
+    if (this->depth != 0) glDeleteTextures(1, &this->depth);
+
+    ShadowCascades::singleton = nullptr;
+}
+
+constexpr float ShadowCascades::DEFAULT_DISTANCE;
+constexpr float ShadowCascades::CASTER_RANGE;
+
+ShadowCascades * ShadowCascades::singleton = nullptr;
@@ -0,0 +1,239 @@
+#include "render.hpp"
+
+static bool lessPosition(const Vertex & a, const Vertex & b) {
+    if (a.position.x != b.position.x) return a.position.x < b.position.x;
+    if (a.position.y != b.position.y) return a.position.y < b.position.y;
+    return a.position.z < b.position.z;
+}
+
+static bool lessAttributes(const Vertex & a, const Vertex & b) {
+    if (lessPosition(a, b)) return true;
+    if (lessPosition(b, a)) return false;
+
+    for (int i=0;i<3;i++)
+        if (a.normal[i] != b.normal[i]) return a.normal[i] < b.normal[i];
+    if (a.uv.x != b.uv.x) return a.uv.x < b.uv.x;
+    return a.uv.y < b.uv.y;
+}
+
+/*
+ * Maps every vertex to the first one that equals it, either in position only or in all attributes the shading uses
+ */
+void MeshSimplifier::weld(const std::vector<Vertex> & vertices, std::vector<unsigned int> & remap, const bool positionOnly) {
+    std::vector<unsigned int> order(vertices.size());
+    for (size_t i=0;i<order.size();i++) order[i] = i;
+
+    auto less = positionOnly ? lessPosition : lessAttributes;
+    std::stable_sort(order.begin(), order.end(),
+        [&vertices, less] (unsigned int a, unsigned int b) { return less(vertices[a], vertices[b]); });
+
+    remap.resize(vertices.size());
+    for (size_t i=0;i<order.size();i++) {
+        const bool same = i > 0 && !less(vertices[order[i - 1]], vertices[order[i]]);
+        remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+    }
+}
+
+/*
+ * Whether moving from onto to turns any of the remaining triangles around from over
+ */
+bool MeshSimplifier::flips(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+        const std::vector<unsigned int> & triangles, const unsigned int from, const unsigned int to) {
+    for (auto t : triangles) {
+        const unsigned int * triangle = &indices[t * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+        glm::vec3 before[3];
+        glm::vec3 after[3];
+        for (int j=0;j<3;j++) {
+            before[j] = vertices[triangle[j]].position;
+            after[j] = triangle[j] == from ? vertices[to].position : before[j];
+        }
+
+        const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0.0f) return true;
+    }
+
+    return false;
+}
+
+/*
+ * Quadric error metric edge collapse (Garland, Heckbert 1997) onto existing vertices, so that every level
+ * can index into the vertices of the full detail mesh. Vertices on open borders and on seams, where one position
+ * carries several uvs or normals, never move, which keeps both the silhouette of open parts and the seams intact.
+ * Collapses are done in passes of independent edges, cheapest first, until the target or the error limit is reached.
+ */
+std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+        const size_t targetIndexCount, const float maxError, float & error) {
+    std::vector<unsigned int> remap;
+    std::vector<unsigned int> positionRemap;
+    MeshSimplifier::weld(vertices, remap, false);
+    MeshSimplifier::weld(vertices, positionRemap, true);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t i=0;i+2<indices.size();i+=3) {
+        const unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (a == b || b == c || a == c) continue;
+        result.push_back(a);
+        result.push_back(b);
+        result.push_back(c);
+    }
+
+    // a position shared by differing vertices is a seam
+    std::vector<unsigned int> wedges(vertices.size(), 0);
+    std::vector<bool> locked(vertices.size(), false);
+    for (size_t v=0;v<vertices.size();v++)
+        if (remap[v] == v) wedges[positionRemap[v]]++;
+    for (size_t v=0;v<vertices.size();v++)
+        if (wedges[v] > 1) locked[v] = true;
+
+    // edges used by one triangle only are borders, by more than two non manifold
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> edges;
+    for (size_t i=0;i<result.size();i+=3) {
+        for (int j=0;j<3;j++) {
+            const unsigned int a = positionRemap[result[i + j]];
+            const unsigned int b = positionRemap[result[i + (j + 1) % 3]];
+            edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+    for (auto & edge : edges) {
+        if (edge.second == 2) continue;
+        locked[edge.first.first] = true;
+        locked[edge.first.second] = true;
+    }
+
+    std::vector<Quadric> quadrics(vertices.size());
+    for (size_t i=0;i<result.size();i+=3) {
+        const glm::vec3 & a = vertices[result[i]].position;
+        const glm::vec3 & b = vertices[result[i + 1]].position;
+        const glm::vec3 & c = vertices[result[i + 2]].position;
+        const glm::vec3 normal = glm::cross(b - a, c - a);
+        const float length = glm::length(normal);
+        if (length <= 0.0f) continue;
+
+        const Quadric quadric(normal / length, -glm::dot(normal / length, a), length / 2.0f);
+        for (int j=0;j<3;j++) quadrics[positionRemap[result[i + j]]] += quadric;
+    }
+
+    const float maxCost = maxError * maxError;
+    float cost = 0.0f;
+
+    while (result.size() > targetIndexCount) {
+        const size_t numberOfTriangles = result.size() / 3;
+
+        std::vector<std::vector<unsigned int>> adjacency(vertices.size());
+        for (size_t t=0;t<numberOfTriangles;t++)
+            for (int j=0;j<3;j++) adjacency[result[t * 3 + j]].push_back(t);
+
+        std::vector<std::tuple<float, unsigned int, unsigned int>> collapses;
+        for (size_t t=0;t<numberOfTriangles;t++) {
+            for (int j=0;j<3;j++) {
+                const unsigned int from = result[t * 3 + j];
+                if (locked[positionRemap[from]]) continue;
+
+                for (int k=1;k<3;k++) {
+                    const unsigned int to = result[t * 3 + (j + k) % 3];
+                    Quadric quadric = quadrics[positionRemap[from]];
+                    quadric += quadrics[positionRemap[to]];
+                    collapses.push_back(std::make_tuple(quadric.evaluate(vertices[to].position), from, to));
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // the neighbourhood of a collapse is left alone for the rest of the pass, the adjacency would be stale
+        std::vector<bool> touched(vertices.size(), false);
+        std::vector<unsigned int> collapseTo(vertices.size());
+        for (size_t v=0;v<collapseTo.size();v++) collapseTo[v] = v;
+
+        const size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        size_t removedTriangles = 0;
+        bool collapsed = false;
+        for (auto & collapse : collapses) {
+            if (std::get<0>(collapse) > maxCost || removedTriangles >= trianglesToRemove) break;
+
+            const unsigned int from = std::get<1>(collapse);
+            const unsigned int to = std::get<2>(collapse);
+            if (touched[from] || touched[to]) continue;
+            if (MeshSimplifier::flips(vertices, result, adjacency[from], from, to)) continue;
+
+            for (auto t : adjacency[from]) {
+                const unsigned int * triangle = &result[t * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to) removedTriangles++;
+                for (int j=0;j<3;j++) touched[triangle[j]] = true;
+            }
+
+            collapseTo[from] = to;
+            quadrics[positionRemap[to]] += quadrics[positionRemap[from]];
+            cost = std::max(cost, std::get<0>(collapse));
+            collapsed = true;
+        }
+
+        if (!collapsed) break;
+
+        std::vector<unsigned int> collapsedIndices;
+        collapsedIndices.reserve(result.size());
+        for (size_t i=0;i<result.size();i+=3) {
+            const unsigned int a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            collapsedIndices.push_back(a);
+            collapsedIndices.push_back(b);
+            collapsedIndices.push_back(c);
+        }
+        result = collapsedIndices;
+    }
+
+    error = glm::sqrt(cost);
+
+    return result;
+}
+
+/*
+ * Every level halves the triangles of the one before, levels that locked seams and borders
+ * keep from getting much smaller are not worth a draw call of their own
+ */
+std::vector<MeshLod> MeshSimplifier::generateLods(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+        const std::string & name) {
+    std::vector<MeshLod> lods;
+    if (vertices.empty() || indices.size() < 3 || indices.size() % 3 != 0) return lods;
+
+    glm::vec3 min = vertices[0].position;
+    glm::vec3 max = min;
+    for (auto & vertex : vertices) {
+        min = glm::min(min, vertex.position);
+        max = glm::max(max, vertex.position);
+    }
+    const float extent = glm::length(max - min);
+
+    const std::vector<unsigned int> * previous = &indices;
+    float maxError = extent * MeshSimplifier::MAX_ERROR;
+    std::string triangles = std::to_string(indices.size() / 3);
+
+    for (unsigned int i=0;i<MeshSimplifier::NUMBER_OF_LODS;i++) {
+        const size_t targetIndexCount = static_cast<size_t>(previous->size() / 3 * MeshSimplifier::LOD_RATIO) * 3;
+        if (targetIndexCount < MeshSimplifier::MIN_TRIANGLES * 3) break;
+
+        MeshLod lod;
+        lod.indices = MeshSimplifier::simplify(vertices, *previous, targetIndexCount, maxError, lod.error);
+        if (lod.indices.empty() || lod.indices.size() > previous->size() * 0.8f) break;
+
+        MeshOptimizer::optimizeIndices(lod.indices, vertices);
+        if (!lods.empty()) lod.error = std::max(lod.error, lods.back().error);
+
+        lods.push_back(lod);
+        previous = &lods.back().indices;
+        maxError *= 2.0f;
+        triangles += " -> " + std::to_string(lod.indices.size() / 3);
+    }
+
+    std::cout << "Generated " << lods.size() << " LODs for " << name << ": " << triangles << " triangles" << std::endl;
+
+    return lods;
+}
+
+constexpr unsigned int MeshSimplifier::NUMBER_OF_LODS;
+constexpr float MeshSimplifier::LOD_RATIO;
+constexpr float MeshSimplifier::MAX_ERROR;
+constexpr size_t MeshSimplifier::MIN_TRIANGLES;
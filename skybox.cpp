@@ -3,7 +3,7 @@
 SkyBox::SkyBox(const std::string & dir, const std::string & texture) {
     this->dir = dir;
     this->texture = std::string(dir + "res/models/" + texture);
-    this->shader = new Shader(this->dir + "/res/shaders/skybox");
+    this->shader = ShaderRegistry::instance()->getShader(this->dir + "/res/shaders/skybox");
 }
 
 void SkyBox::init() {
@@ -20,9 +20,10 @@ void SkyBox::init() {
 
     for (auto & t : texNames) {
         std::string f(this->texture + t);
-        std::unique_ptr<Texture> tex(new Texture());
+        std::shared_ptr<Texture> tex(new Texture());
         tex->setType(Model::DIFFUSE_TEXTURE);
         tex->setPath(f);
+        tex->setStreamable(false);
         tex->load();
         if (tex->isValid()) textures.push_back(std::move(tex));
         else {
@@ -34,15 +35,54 @@ void SkyBox::init() {
     glGenTextures(1, &this->textureId);
     glBindTexture(GL_TEXTURE_CUBE_MAP, this->textureId);
 
-    int c = 0;
+    // storage is allocated here, the faces are filled in by the TextureUploader
+    const GLuint textureId = this->textureId;
+    GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+    GLint levels = 1;
     for (auto & skyTex : this->textures) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + c, 0, GL_RGB,
-                skyTex->getTextureSurface()->w, skyTex->getTextureSurface()->h, 0,
-                skyTex->getImageFormat(), GL_UNSIGNED_BYTE, skyTex->getTextureSurface()->pixels);
-        c++;
+        if (skyTex->isCompressed()) {
+            const GLenum format = skyTex->getCompressedFormat();
+            levels = skyTex->getLevels().size();
+
+            for (GLint level=0;level<levels;level++) {
+                const TextureLevel & textureLevel = skyTex->getLevels()[level];
+                const GLsizei width = textureLevel.width, height = textureLevel.height, size = skyTex->getPixelSize(level);
+                glCompressedTexImage2D(face, level, format, width, height, 0, size, nullptr);
+
+                TextureUploader::instance()->queue(size,
+                    [skyTex, level, size] (unsigned char * destination) {
+                        return skyTex->readPixels(level, destination, size);
+                    },
+                    [textureId, face, level, format, width, height, size] (const bool filled) {
+                        if (!filled) return;
+                        TextureArrays::instance()->bindForUpdate(GL_TEXTURE_CUBE_MAP, textureId);
+                        glCompressedTexSubImage2D(face, level, 0, 0, width, height, format, size, nullptr);
+                    });
+            }
+        } else {
+            const GLenum imageFormat = skyTex->getImageFormat();
+            const GLsizei width = skyTex->getWidth(), height = skyTex->getHeight();
+            glTexImage2D(face, 0, GL_RGB, width, height, 0, imageFormat, GL_UNSIGNED_BYTE, nullptr);
+
+            const size_t size = skyTex->getPixelSize(0);
+            TextureUploader::instance()->queue(size,
+                [skyTex, size] (unsigned char * destination) {
+                    return skyTex->readPixels(0, destination, size);
+                },
+                [skyTex, textureId, face, imageFormat, width, height] (const bool filled) {
+                    if (!filled) return;
+                    TextureArrays::instance()->bindForUpdate(GL_TEXTURE_CUBE_MAP, textureId);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                    glTexSubImage2D(face, 0, 0, 0, width, height, imageFormat, GL_UNSIGNED_BYTE, nullptr);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    skyTex->releasePixels();
+                });
+        }
+        face++;
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -1,27 +1,143 @@
 #include "state.hpp"
 
-GameState::GameState(std::string & root) {
+GameState::GameState(std::string & root, const RenderPath renderPath) {
     this->root = root;
+    this->renderPath = renderPath;
 }
 
 void GameState::init() {
+    // has to be in place before the first program gets compiled
+    if (this->renderPath == RENDER_PATH_DEFERRED) {
+        ShaderRegistry::instance()->addGlobalDefine("DEFERRED");
+        this->gBuffer = new GBuffer();
+        this->lightingShader = ShaderRegistry::instance()->getShader(this->root + "/res/shaders/lighting");
+    }
+
+    // submitted ahead of the assets, the driver compiles while they load
+    this->depthShader = ShaderRegistry::instance()->getShader(this->root + "/res/shaders/depth");
+    this->transparencyBuffer =
+        new TransparencyBuffer(ShaderRegistry::instance()->getShader(this->root + "/res/shaders/transparency_composite"));
+
     this->terrain = new Terrain(this->root);
     this->terrain->init();
+    this->vegetation = new Vegetation(this->terrain,
+        ShaderRegistry::instance()->getShader(this->root + "/res/shaders/textures", { "VEGETATION" }));
+    this->vegetation->init();
     this->sky = new SkyBox(this->root, "sky");
     this->sky->init();
+
+    ParticleSystem::instance()->init(this->root);
+}
+
+/*
+ * The samples of the pass that writes depth are measured, with the pre-pass on that is the pre-pass itself,
+ * separate thresholds for switching on and off keep the mode from flipping every frame
+ */
+bool GameState::isDepthPrePassActive(const std::string & pass) {
+    const DepthPrePass mode = this->getDepthPrePass(pass);
+    if (mode != DEPTH_PRE_PASS_AUTO) return mode == DEPTH_PRE_PASS_ON;
+
+    const float overdraw = RenderStatistics::instance()->getOverdraw(pass);
+    bool & active = this->depthPrePassesActive[pass];
+    if (!active && overdraw > GameState::DEPTH_PRE_PASS_ENABLE_OVERDRAW) active = true;
+    else if (active && overdraw < GameState::DEPTH_PRE_PASS_DISABLE_OVERDRAW) active = false;
+
+    return active;
+}
+
+/*
+ * With the pre-pass on, depth is laid down first without color writes and the shading pass
+ * then only runs the fragment shader for the visible surface of every pixel
+ */
+void GameState::renderPass(const std::string & pass, std::function<void(Shader *)> renderDepth, std::function<void(const bool)> render) {
+    const bool depthPrePass = this->depthShader != nullptr && this->isDepthPrePassActive(pass);
+
+    if (depthPrePass) {
+        this->depthShader->use();
+        if (this->depthShader->isBeingUsed()) {
+            this->depthShader->setMat4("view", Camera::instance()->getViewMatrix());
+            this->depthShader->setMat4("projection", Camera::instance()->getPerspective());
+
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            RenderStatistics::instance()->begin(pass);
+            renderDepth(this->depthShader);
+            RenderStatistics::instance()->end();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            this->depthShader->stopUse();
+
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+            render(true);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+            return;
+        }
+    }
+
+    RenderStatistics::instance()->begin(pass);
+    render(false);
+    RenderStatistics::instance()->end();
 }
 
 void GameState::render() {
-    if (this->terrain != nullptr) this->terrain->render();
+    ShadowCascades::instance()->update(this->depthShader,
+        [this] (Shader * shader) {
+            if (this->terrain != nullptr) this->terrain->renderDepth(shader);
+            this->staticBatcher->renderDepth(shader, false);
+        },
+        [this] (Shader * shader) { for (auto & sceneEntry : this->scene) sceneEntry.second->renderDepth(shader); });
 
-    for (auto & sceneEntry : this->scene) sceneEntry.second->render();
+    const bool deferred = this->gBuffer != nullptr && this->gBuffer->begin();
+
+    if (this->terrain != nullptr) {
+        this->renderPass(GameState::TERRAIN_PASS,
+            [this] (Shader * shader) { this->terrain->renderDepth(shader); },
+            [this] (const bool) { this->terrain->render(); });
+    }
+
+    this->renderPass(GameState::STATIC_PASS,
+        [this] (Shader * shader) { this->staticBatcher->renderDepth(shader); },
+        [this] (const bool) { this->staticBatcher->render(); });
+
+    this->renderPass(GameState::DYNAMIC_PASS,
+        [this] (Shader * shader) { for (auto & sceneEntry : this->scene) sceneEntry.second->renderDepth(shader); },
+        [this] (const bool depthPrePassed) { for (auto & sceneEntry : this->scene) sceneEntry.second->render(depthPrePassed); });
+
+    if (this->vegetation != nullptr) this->vegetation->render();
+
+    if (deferred) {
+        this->gBuffer->end();
+        this->gBuffer->light(this->lightingShader);
+    }
 
     if (this->sky != nullptr) this->sky->render();
+
+    // translucent geometry goes over the finished opaque scene in whatever order, see TransparencyBuffer
+    if (this->transparencyBuffer != nullptr && this->transparencyBuffer->begin()) {
+        RenderStatistics::instance()->begin(GameState::TRANSLUCENT_PASS);
+        this->staticBatcher->renderTranslucent();
+        for (auto & sceneEntry : this->scene) sceneEntry.second->renderTranslucent();
+        RenderStatistics::instance()->end();
+
+        this->transparencyBuffer->end();
+    }
+
+    // after everything opaque, the particles fade against its depth
+    ParticleSystem::instance()->render();
+
+    RenderStatistics::instance()->update();
 }
 
 void GameState::addRenderable(Renderable * renderable) {
     if (renderable == nullptr) return;
 
+    if (renderable->isStatic()) {
+        this->staticBatcher->addRenderable(renderable);
+        ShadowCascades::instance()->invalidate();
+        return;
+    }
+
     RenderableGroup * group = this->scene[renderable->getRenderableID()];
     if (group == nullptr) {
         group = new RenderableGroup(renderable->getRenderableID());
@@ -31,12 +147,16 @@ void GameState::addRenderable(Renderable * renderable) {
 }
 
 GameState::~GameState() {
+    // the workers read the terrain
+    if (this->vegetation != nullptr) delete this->vegetation;
+
     if (this->terrain != nullptr) {
         this->terrain->cleanUp();
         if (this->terrain != nullptr) delete this->terrain;
     }
 
     for (auto & sceneEntry : this->scene) delete sceneEntry.second;
+    delete this->staticBatcher;
 
     if (this->sky != nullptr) {
         this->sky->cleanUp();
@@ -44,5 +164,16 @@ GameState::~GameState() {
     }
 
     this->scene.clear();
+
+    if (this->gBuffer != nullptr) delete this->gBuffer;
+    if (this->transparencyBuffer != nullptr) delete this->transparencyBuffer;
 }
 
+
+const std::string GameState::TERRAIN_PASS = "terrain";
+const std::string GameState::STATIC_PASS = "static";
+const std::string GameState::DYNAMIC_PASS = "dynamic";
+const std::string GameState::TRANSLUCENT_PASS = "translucent";
+
+constexpr float GameState::DEPTH_PRE_PASS_ENABLE_OVERDRAW;
+constexpr float GameState::DEPTH_PRE_PASS_DISABLE_OVERDRAW;
@@ -7,25 +7,112 @@ class RenderableGroup {
     private:
         std::string id = "";
         std::vector<Renderable*> content;
+        bool instanceDataSet = false;
+
+        void setInstanceData();
 
     public:
         RenderableGroup(std::string id);
         ~RenderableGroup();
+        void render(const bool depthPrePassed = false);
+        void renderTranslucent();
+        void renderDepth(Shader * shader);
+        void addRenderable(Renderable * renderable);
+};
+
+class StaticBatch {
+    private:
+        Mesh mesh;
+        Shader * shader = nullptr;
+        GLushort materialIndex = 0;
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    public:
+        StaticBatch(Shader * shader, Mesh * source, GLushort materialIndex);
+        void add(Mesh * source, const glm::mat4 & transformation);
+        void init();
         void render();
+        // shadow casters outside of the view frustum still count
+        void renderDepth(Shader * shader, const bool cull = true);
+        bool isTranslucent() {
+            return this->mesh.isTranslucent(this->shader);
+        }
+        void cleanUp();
+};
+
+class StaticBatcher {
+    private:
+        bool baked = false;
+        std::vector<Renderable*> content;
+        std::map<std::string, StaticBatch *> batches;
+
+        void bake();
+        void cleanUp();
+
+    public:
+        static constexpr float CELL_SIZE = 50.0f;
+
+        ~StaticBatcher();
+        void render();
+        void renderTranslucent();
+        void renderDepth(Shader * shader, const bool cull = true);
         void addRenderable(Renderable * renderable);
 };
 
+enum DepthPrePass {
+    DEPTH_PRE_PASS_OFF,
+    DEPTH_PRE_PASS_ON,
+    // on while the pass overdraws the viewport more than DEPTH_PRE_PASS_ENABLE_OVERDRAW times
+    DEPTH_PRE_PASS_AUTO
+};
+
+enum RenderPath {
+    RENDER_PATH_FORWARD,
+    // opaque geometry fills a G-buffer which is lit once per pixel
+    RENDER_PATH_DEFERRED
+};
+
 class GameState {
     private:
         std::string root = "";
         std::map<std::string, RenderableGroup *> scene;
+        StaticBatcher * staticBatcher = new StaticBatcher();
         Terrain * terrain = nullptr;
+        Vegetation * vegetation = nullptr;
         SkyBox * sky = nullptr;
+        Shader * depthShader = nullptr;
+        RenderPath renderPath = RENDER_PATH_FORWARD;
+        GBuffer * gBuffer = nullptr;
+        Shader * lightingShader = nullptr;
+        TransparencyBuffer * transparencyBuffer = nullptr;
+        std::map<std::string, DepthPrePass> depthPrePasses;
+        std::map<std::string, bool> depthPrePassesActive;
+
+        bool isDepthPrePassActive(const std::string & pass);
+        void renderPass(const std::string & pass, std::function<void(Shader *)> renderDepth, std::function<void(const bool)> render);
 
     public:
-        GameState(std::string & root);
+        static const std::string TERRAIN_PASS;
+        static const std::string STATIC_PASS;
+        static const std::string DYNAMIC_PASS;
+        static const std::string TRANSLUCENT_PASS;
+        static constexpr float DEPTH_PRE_PASS_ENABLE_OVERDRAW = 2.0f;
+        static constexpr float DEPTH_PRE_PASS_DISABLE_OVERDRAW = 1.5f;
+
+        GameState(std::string & root, const RenderPath renderPath = RENDER_PATH_FORWARD);
         void init();
         void render();
+        RenderPath getRenderPath() {
+            return this->renderPath;
+        }
+        void setDepthPrePass(const std::string & pass, const DepthPrePass mode) {
+            this->depthPrePasses[pass] = mode;
+        }
+        DepthPrePass getDepthPrePass(const std::string & pass) {
+            std::map<std::string, DepthPrePass>::iterator val(this->depthPrePasses.find(pass));
+            return val != this->depthPrePasses.end() ? val->second : DEPTH_PRE_PASS_AUTO;
+        }
         void addRenderable(Renderable * renderable);
         ~GameState();
 };
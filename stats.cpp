@@ -0,0 +1,60 @@
+#include "render.hpp"
+
+/*
+ * Only one occlusion query can be active, passes must not nest
+ */
+void RenderStatistics::begin(const std::string & pass) {
+    if (!this->activePass.empty()) return;
+
+    RenderPassQueries & passQueries = this->PASSES[pass];
+    const unsigned int slot = this->frame % RenderPassQueries::QUERY_FRAMES;
+
+    if (passQueries.queries[slot] == 0) glGenQueries(1, &passQueries.queries[slot]);
+    else if (passQueries.issued[slot]) glGetQueryObjectuiv(passQueries.queries[slot], GL_QUERY_RESULT, &passQueries.samplesPassed);
+
+    glBeginQuery(GL_SAMPLES_PASSED, passQueries.queries[slot]);
+    passQueries.issued[slot] = true;
+
+    this->activePass = pass;
+}
+
+void RenderStatistics::end() {
+    if (this->activePass.empty()) return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    this->activePass = "";
+}
+
+void RenderStatistics::update() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] > 0 && viewport[3] > 0) this->viewportPixels = viewport[2] * viewport[3];
+
+    this->frame++;
+}
+
+GLuint RenderStatistics::getSamplesPassed(const std::string & pass) {
+    std::map<std::string, RenderPassQueries>::iterator val(this->PASSES.find(pass));
+    if (val == this->PASSES.end()) return 0;
+
+    return val->second.samplesPassed;
+}
+
+/*
+ * How often on average every pixel of the viewport was written by the pass
+ */
+float RenderStatistics::getOverdraw(const std::string & pass) {
+    return static_cast<float>(this->getSamplesPassed(pass)) / static_cast<float>(this->viewportPixels);
+}
+
+RenderStatistics::~RenderStatistics() {
+    for (auto & passEntry : this->PASSES) {
+        for (auto & query : passEntry.second.queries)
+            if (query != 0) glDeleteQueries(1, &query);
+    }
+    this->PASSES.clear();
+
+    RenderStatistics::singleton = nullptr;
+}
+
+RenderStatistics * RenderStatistics::singleton = nullptr;
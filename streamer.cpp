@@ -0,0 +1,153 @@
+#include "render.hpp"
+
+GLint TextureStreamer::getResidentLevel(const GLsizei width, const GLsizei height, const GLint levels) {
+    GLint level = 0;
+    while (level < levels - 1 && std::max(width >> level, height >> level) > TextureStreamer::RESIDENT_SIZE) level++;
+
+    return level;
+}
+
+/*
+ * The level at which one texel covers about one pixel, assuming the texture spans the projected size once
+ */
+void TextureStreamer::request(Texture * texture, const float projectedSize) {
+    if (texture == nullptr) return;
+
+    TextureArray * array = texture->getArray();
+    if (array == nullptr || !array->isStreamable()) return;
+
+    const float textureSize = static_cast<float>(std::max(array->getWidth(), array->getHeight()));
+    const GLint level = static_cast<GLint>(glm::floor(glm::log2(textureSize / std::max(projectedSize, 1.0f))));
+
+    array->request(glm::clamp(level, 0, array->getLevels() - 1), this->frame);
+}
+
+/*
+ * Allocates the level right away, it is only sampled once all layers have arrived and it becomes the base level
+ */
+void TextureStreamer::stream(TextureArray * array, const GLint level) {
+    std::shared_ptr<TextureStreamingJob> job(new TextureStreamingJob());
+    job->array = array;
+    job->level = level;
+    job->generation = array->getGeneration();
+
+    const std::vector<std::shared_ptr<Texture>> textures = array->getTextures();
+    if (textures.empty()) return;
+    job->remainingLayers = textures.size();
+
+    array->setStreaming(true);
+    array->allocateLevel(level);
+
+    const size_t size = array->getLayerSize(level);
+    for (auto & texture : textures) {
+        const GLint layer = texture->getLayer();
+        TextureUploader::instance()->queue(size,
+            [texture, level, size] (unsigned char * destination) {
+                return texture->readPixels(level, destination, size);
+            },
+            [this, job, layer] (const bool filled) {
+                this->submit(job, layer, filled);
+            });
+    }
+}
+
+void TextureStreamer::submit(std::shared_ptr<TextureStreamingJob> job, const GLint layer, const bool filled) {
+    TextureArray * array = job->array;
+
+    // a re-specified array has discarded the level
+    const bool current = job->generation == array->getGeneration();
+
+    if (!filled) job->failed = true;
+    else if (current) array->uploadLayer(job->level, layer, nullptr);
+
+    if (--job->remainingLayers > 0) return;
+
+    array->setStreaming(false);
+    if (!current) return;
+
+    if (job->failed) {
+        std::cerr << "Failed to stream texture level " << job->level << ", streaming disabled for its array" << std::endl;
+        array->releaseLevel(job->level);
+        array->setStreamable(false);
+    } else array->setResidentLevel(job->level);
+}
+
+/*
+ * For rendering that cannot wait for later frames, such as baking while loading. Level by level, as streaming would,
+ * each one has to be resident before the next finer one can become the base level
+ */
+void TextureStreamer::makeResident(TextureArray * array) {
+    if (array == nullptr) return;
+
+    // queues the layers that were added since the last bind
+    array->getId();
+    TextureUploader::instance()->flush();
+
+    while (array->isStreamable() && array->getResidentLevel() > 0) {
+        const GLint residentLevel = array->getResidentLevel();
+        if (!array->isStreaming()) this->stream(array, residentLevel - 1);
+        TextureUploader::instance()->flush();
+
+        if (array->getResidentLevel() == residentLevel) break;
+    }
+
+    TextureArrays::instance()->generateMipmaps();
+}
+
+/*
+ * Called once per frame on the GL thread: evicts the finest levels of the least recently used arrays
+ * while over budget and streams the next finer level where it was requested
+ */
+void TextureStreamer::update() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[3] > 0) this->viewportHeight = viewport[3];
+
+    std::vector<TextureArray *> arrays = TextureArrays::instance()->getArrays();
+
+    size_t residentSize = 0;
+    for (auto * array : arrays) residentSize += array->getResidentSize();
+
+    std::vector<TextureArray *> streamableArrays;
+    for (auto * array : arrays)
+        if (array->isStreamable() && !array->isDirty()) streamableArrays.push_back(array);
+
+    std::stable_sort(streamableArrays.begin(), streamableArrays.end(),
+        [] (TextureArray * a, TextureArray * b) { return a->getLastUsed() < b->getLastUsed(); });
+
+    // arrays in use keep the levels they need
+    for (auto * array : streamableArrays) {
+        if (residentSize <= this->budget) break;
+        if (array->isStreaming()) continue;
+
+        const GLint residentLevel = TextureStreamer::getResidentLevel(array->getWidth(), array->getHeight(), array->getLevels());
+        while (residentSize > this->budget && array->getResidentLevel() < residentLevel &&
+                (array->getLastUsed() != this->frame || array->getResidentLevel() < array->getRequestedLevel())) {
+            residentSize -= array->getLevelSize(array->getResidentLevel());
+            array->evictLevel();
+        }
+    }
+
+    for (auto it = streamableArrays.rbegin(); it != streamableArrays.rend(); it++) {
+        TextureArray * array = *it;
+        if (array->getLastUsed() != this->frame) break;
+        if (array->isStreaming() || array->getRequestedLevel() >= array->getResidentLevel()) continue;
+
+        const GLint level = array->getResidentLevel() - 1;
+        const size_t levelSize = array->getLevelSize(level);
+        if (residentSize + levelSize > this->budget) continue;
+        residentSize += levelSize;
+
+        this->stream(array, level);
+    }
+
+    this->frame++;
+}
+
+TextureStreamer::~TextureStreamer() {
+    TextureStreamer::singleton = nullptr;
+}
+
+constexpr size_t TextureStreamer::DEFAULT_BUDGET;
+
+TextureStreamer * TextureStreamer::singleton = nullptr;
@@ -11,10 +11,15 @@ Terrain::Terrain(const std::string & dir) {
     int start = -100, end = 100, step = 2;
     int numberOfVertices = (end - start) / step;
 
+    this->origin = glm::vec2(start);
+    this->spacing = step;
+    this->size = numberOfVertices;
+
     for (int row=start;row<end;row+=step) {
         for (int col=start;col<end;col+=step) {
             const float randHeight = static_cast<const float>((rand() % 4));
             this->mesh.vertices.push_back(Vertex(glm::vec3(row, randHeight, col)));
+            this->heights.push_back(randHeight);
         }
     }
 
@@ -62,96 +67,64 @@ Terrain::Terrain(const std::string & dir) {
 void Terrain::init() {
     if (this->initialized) return;
 
-    this->useShader(new Shader(this->dir + "/res/shaders/terrain"));
-
     std::vector<std::string> texNames = {
             "/res/models/grass.png"
     };
 
     for (auto & t : texNames) {
         std::string f(this->dir + t);
-        std::unique_ptr<Texture> tex(new Texture());
+        std::shared_ptr<Texture> tex(new Texture());
         tex->setType(Model::DIFFUSE_TEXTURE);
         tex->setPath(f);
         tex->load();
-        if (tex->isValid()) this->textures.push_back(std::move(tex));
-        else {
+        if (tex->isValid()) {
+            TextureArrays::instance()->add(tex);
+            this->textures.push_back(tex);
+        } else {
             std::cerr << "Failed to load terrain texture: " + f << std::endl;
             return;
         }
     }
 
-    glGenTextures(1, &this->textureId);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, this->textureId);
-
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    GLfloat color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
-
-    int c = 0;
-    for (auto & tex : this->textures) {
-        GLenum imageFormat;
-           if (!Texture::findImageFormat(tex->getTextureSurface(), &imageFormat)) {
-               std::cerr << "Unsupported Image Format: " << std::endl;
-               return;
-           }
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->getTextureSurface()->w, tex->getTextureSurface()->h, 0,
-                        imageFormat, GL_UNSIGNED_BYTE, tex->getTextureSurface()->pixels);
-        c++;
-    }
-
-    /*glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA, 100, 100, this->textures.size());
-
-    int c = 0;
-    for (auto & tex : this->textures) {
-        std::cout << tex->getTextureSurface()->w << "x" << tex->getTextureSurface()->w << std::endl;
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
-                0, 0, 0, c,
-                tex->getTextureSurface()->w, tex->getTextureSurface()->h, 1,
-                GL_RGBA, GL_UNSIGNED_BYTE, tex->getTextureSurface()->pixels);
-        c++;
-    }*/
+    std::vector<std::string> defines;
+    if (!this->textures.empty()) defines.push_back("HAS_TEXTURE");
+    this->useShader(ShaderRegistry::instance()->getShader(this->dir + "/res/shaders/terrain", defines));
 
     this->mesh.init();
 
     this->setColor(1.0f, 1.0f, 1.0f, 1.0f);
-    std::vector<Material> materials;
-    materials.push_back(this->getMaterial());
-    this->setMaterials(materials);
+    std::vector<GLushort> materialIndices;
+    materialIndices.push_back(this->getMaterialIndex());
+    this->setMaterialIndices(materialIndices);
 
     this->setPosition(glm::vec3(0.0f));
-    std::vector<glm::mat4> modelMatrices;
-    modelMatrices.push_back(this->calculateTransformationMatrix());
-    this->setModelMatrices(modelMatrices);
+    std::vector<InstanceTransform> instanceTransforms;
+    instanceTransforms.push_back(this->calculateInstanceTransform());
+    this->setInstanceTransforms(instanceTransforms);
 
     this->initialized = true;
 }
 
 void Terrain::render() {
-    if (!this->initialized || this->shader == nullptr) return;
+    if (!this->initialized || this->getShader() == nullptr) return;
 
     this->shader->use();
     if (this->shader->isBeingUsed()) {
-        this->shader->setMat4("view", Camera::instance()->getViewMatrix());
-        this->shader->setMat4("projection", Camera::instance()->getPerspective());
-        this->shader->setVec3("ambientLight",  World::instance()->getAmbientLight());
-        this->shader->setVec3("sunDirection", World::instance()->getSunDirection());
-        this->shader->setVec3("sunLightColor", World::instance()->getSunLightColor());
-        this->shader->setVec3("eyePosition", Camera::instance()->getPosition());
+        this->shader->setSceneUniforms();
 
         //shader->dumpActiveShaderAttributes();
         if (this->textures.size() > 0) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, this->textureId);
-            this->shader->setInt("has_texture", 1);
+            // tiled ground is always seen up close
+            std::vector<GLint> layers;
+            for (auto & tex : this->textures) {
+                TextureStreamer::instance()->request(tex.get(), std::numeric_limits<float>::max());
+                layers.push_back(tex->getLayer());
+            }
+
+            TextureArrays::instance()->bind(0, this->textures[0]->getArray());
             this->shader->setInt("textureArray", 0);
-        } else this->shader->setInt("has_texture", 0);
+            this->shader->setIntVec("textureLayers", layers);
+        }
 
         this->mesh.render(this->shader);
 
@@ -159,18 +132,61 @@ void Terrain::render() {
     }
 }
 
-void Terrain::setMaterials(std::vector<Material> & materials) {
-    this->mesh.setMaterials(materials);
+void Terrain::renderDepth(Shader * shader) {
+    if (!this->initialized) return;
+
+    this->mesh.render(shader, false);
+}
+
+/*
+ * Height and its slopes along x and z on the triangle of the mesh the point lies on, every quad is split
+ * along the diagonal from the next column to the next row. x runs along the rows and z along the columns.
+ * Outside of the grid the closest edge is sampled
+ */
+glm::vec3 Terrain::sampleSurface(const float x, const float z) const {
+    if (this->size == 0) return glm::vec3(0.0f);
+
+    const glm::vec2 grid = glm::clamp((glm::vec2(x, z) - this->origin) / this->spacing, glm::vec2(0.0f), glm::vec2(this->size - 1));
+    const int row = std::min(static_cast<int>(grid.x), this->size - 2);
+    const int col = std::min(static_cast<int>(grid.y), this->size - 2);
+    if (row < 0 || col < 0) return glm::vec3(this->heights[0], 0.0f, 0.0f);
+
+    const glm::vec2 blend = grid - glm::vec2(row, col);
+    const float h00 = this->heights[row * this->size + col];
+    const float h01 = this->heights[row * this->size + col + 1];
+    const float h10 = this->heights[(row + 1) * this->size + col];
+    const float h11 = this->heights[(row + 1) * this->size + col + 1];
+
+    if (blend.x + blend.y <= 1.0f) {
+        return glm::vec3(h00 + (h10 - h00) * blend.x + (h01 - h00) * blend.y,
+            (h10 - h00) / this->spacing, (h01 - h00) / this->spacing);
+    }
+
+    return glm::vec3(h11 + (h01 - h11) * (1.0f - blend.x) + (h10 - h11) * (1.0f - blend.y),
+        (h11 - h01) / this->spacing, (h11 - h10) / this->spacing);
+}
+
+float Terrain::getHeight(const float x, const float z) const {
+    return this->sampleSurface(x, z).x;
+}
+
+glm::vec3 Terrain::getNormal(const float x, const float z) const {
+    const glm::vec3 surface = this->sampleSurface(x, z);
+
+    return glm::normalize(glm::vec3(-surface.y, 1.0f, -surface.z));
+}
+
+void Terrain::setMaterialIndices(std::vector<GLushort> & materialIndices) {
+    this->mesh.setMaterialIndices(materialIndices);
 }
 
-void Terrain::setModelMatrices(std::vector<glm::mat4> & modelMatrices) {
-    this->mesh.setModelMatrices(modelMatrices);
+void Terrain::setInstanceTransforms(std::vector<InstanceTransform> & instanceTransforms) {
+    this->mesh.setInstanceTransforms(instanceTransforms);
 }
 
 void Terrain::cleanUp() {
     if (!this->initialized) return;
 
-    glDeleteTextures(1, &this->textureId);
     this->mesh.cleanUp();
 
     this->initialized = false;
@@ -0,0 +1,450 @@
+#include "render.hpp"
+
+/*
+ * Prefers the encoded mip chain cached next to the image, encoding and caching it on first use.
+ * Of a cached chain only the level sizes are read, the pixels are read from the cache when uploading.
+ * Without S3TC support the plain surface is kept until uploaded and mipmapped by the driver.
+ */
+void Texture::load() {
+    if (this->loaded) return;
+    this->loaded = true;
+
+    const bool compress = TextureEncoder::isSupported();
+    if (compress && TextureEncoder::loadCache(this->path, this->compressedFormat, this->levels, 0)) {
+        this->width = this->levels[0].width;
+        this->height = this->levels[0].height;
+        this->cached = true;
+        this->valid = true;
+        return;
+    }
+
+    this->textureSurface = IMG_Load(this->path.c_str());
+    if (this->textureSurface == nullptr) {
+        std::cerr << "Failed to load texture: " << this->path << std::endl;
+        return;
+    }
+
+    if (!Texture::findImageFormat(this->textureSurface, &this->imageFormat)) {
+        std::cerr << "Unsupported Texture Format: " << this->path << std::endl;
+        return;
+    }
+
+    this->width = this->textureSurface->w;
+    this->height = this->textureSurface->h;
+    this->bytesPerPixel = this->textureSurface->format->BytesPerPixel;
+    this->valid = true;
+
+    if (!compress) {
+        this->streamable = false;
+        return;
+    }
+
+    this->levels = TextureEncoder::encode(this->textureSurface, this->type == Model::TEXTURE_NORMALS, this->compressedFormat);
+    if (this->levels.empty()) {
+        this->compressedFormat = 0;
+        this->streamable = false;
+        return;
+    }
+
+    SDL_FreeSurface(this->textureSurface);
+    this->textureSurface = nullptr;
+
+    // without a written cache the levels have to stay in memory and cannot be streamed
+    this->cached = TextureEncoder::saveCache(this->path, this->compressedFormat, this->levels);
+    if (this->cached) this->releasePixels();
+    else this->streamable = false;
+}
+
+size_t Texture::getPixelSize(const GLint level) {
+    if (this->compressedFormat == 0) return level == 0 ? static_cast<size_t>(this->width) * this->height * this->bytesPerPixel : 0;
+    if (level < 0 || level >= static_cast<GLint>(this->levels.size())) return 0;
+
+    const size_t blocks = ((this->levels[level].width + 3) / 4) * ((this->levels[level].height + 3) / 4);
+    return blocks * TextureEncoder::getBlockSize(this->compressedFormat);
+}
+
+/*
+ * Called by the upload workers, reads the cache or decodes the image again if the pixels were released
+ */
+bool Texture::readPixels(const GLint level, unsigned char * destination, const size_t size) {
+    std::lock_guard<std::mutex> lock(this->pixelsMutex);
+
+    if (destination == nullptr || size != this->getPixelSize(level)) return false;
+
+    if (this->compressedFormat != 0) {
+        const std::vector<unsigned char> & data = this->levels[level].data;
+        if (!data.empty()) {
+            memcpy(destination, data.data(), size);
+            return true;
+        }
+
+        return this->cached && TextureEncoder::loadCacheLevel(this->path, level, destination, size);
+    }
+
+    if (this->textureSurface == nullptr && !this->path.empty()) this->textureSurface = IMG_Load(this->path.c_str());
+    if (this->textureSurface == nullptr || this->textureSurface->format->BytesPerPixel != this->bytesPerPixel) return false;
+
+    return TextureUploader::copySurface(this->textureSurface, destination);
+}
+
+// pixels that could not be read again, like rendered text, are kept
+void Texture::releasePixels() {
+    std::lock_guard<std::mutex> lock(this->pixelsMutex);
+
+    if (this->path.empty()) return;
+
+    if (this->textureSurface != nullptr) SDL_FreeSurface(this->textureSurface);
+    this->textureSurface = nullptr;
+
+    if (this->cached)
+        for (auto & level : this->levels) std::vector<unsigned char>().swap(level.data);
+}
+
+Texture::~Texture() {
+    if (this->array != nullptr) this->array->removeLayer(this->layer);
+
+    if (this->textureSurface != nullptr) SDL_FreeSurface(this->textureSurface);
+}
+
+TextureArray::TextureArray(const GLsizei width, const GLsizei height, const GLenum compressedFormat, const GLint levels, const bool streamable) {
+    this->width = width;
+    this->height = height;
+    this->compressedFormat = compressedFormat;
+    this->levels = levels;
+    this->streamable = streamable && compressedFormat != 0;
+}
+
+GLint TextureArray::addLayer(Texture * texture) {
+    GLint layer = std::find(this->layers.begin(), this->layers.end(), nullptr) - this->layers.begin();
+    if (layer == static_cast<GLint>(this->layers.size())) this->layers.push_back(texture);
+    else this->layers[layer] = texture;
+
+    this->pendingLayers.push_back(layer);
+    this->dirty = true;
+
+    return layer;
+}
+
+// the storage of the layer stays allocated for the next texture added
+void TextureArray::removeLayer(const GLint layer) {
+    if (layer < 0 || layer >= static_cast<GLint>(this->layers.size())) return;
+
+    this->layers[layer] = nullptr;
+    this->pendingLayers.erase(std::remove(this->pendingLayers.begin(), this->pendingLayers.end(), layer), this->pendingLayers.end());
+}
+
+void TextureArray::detachLayers() {
+    for (auto * texture : this->layers)
+        if (texture != nullptr) texture->setArrayLayer(nullptr, -1);
+
+    this->layers.clear();
+    this->pendingLayers.clear();
+}
+
+/*
+ * Forgets the GL texture, e.g. after the context was lost, all layers are read and uploaded again on the next bind
+ */
+void TextureArray::invalidate() {
+    this->id = 0;
+    this->capacity = 0;
+    this->generation++;
+    this->residentLevel = 0;
+    this->streaming = false;
+    this->dirty = true;
+}
+
+void TextureArray::setSampling() {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, this->residentLevel);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, this->levels - 1);
+
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(maxAnisotropy, 8.0f));
+    }
+}
+
+void TextureArray::bindForUpdate() {
+    TextureArrays::instance()->bindForUpdate(GL_TEXTURE_2D_ARRAY, this->id);
+}
+
+/*
+ * Queues the pixel data of the layers added since the last bind with the TextureUploader.
+ * Storage is only (re)specified once the capacity is exceeded, which discards all pending uploads.
+ * The texture name is kept so that bindings cached by TextureArrays stay valid.
+ */
+void TextureArray::upload() {
+    if (this->id == 0) glGenTextures(1, &this->id);
+    this->bindForUpdate();
+
+    const GLint coarseLevel = this->streamable ? TextureStreamer::getResidentLevel(this->width, this->height, this->levels) : 0;
+
+    if (static_cast<GLsizei>(this->layers.size()) > this->capacity) {
+        this->capacity = std::max(static_cast<GLsizei>(this->layers.size()), this->capacity * 2);
+        this->generation++;
+
+        this->pendingLayers.clear();
+        for (size_t layer=0;layer<this->layers.size();layer++)
+            if (this->layers[layer] != nullptr) this->pendingLayers.push_back(layer);
+        this->residentLevel = coarseLevel;
+        this->setSampling();
+
+        for (GLint level=0;level<this->levels;level++) {
+            if (level < this->residentLevel) this->releaseLevel(level);
+            else this->allocateLevel(level);
+        }
+    } else if (this->residentLevel < coarseLevel) {
+        // the added layers only hold the coarse levels in memory, the finer ones are streamed in again
+        this->generation++;
+        this->setResidentLevel(coarseLevel);
+        for (GLint level=0;level<coarseLevel;level++) this->releaseLevel(level);
+    }
+
+    for (auto layer : this->pendingLayers) this->queueLayer(layer);
+    this->pendingLayers.clear();
+
+    this->dirty = false;
+}
+
+void TextureArray::queueLayer(const GLint layer) {
+    if (this->layers[layer] == nullptr) return;
+
+    // the uploads keep the texture alive until they are submitted
+    std::shared_ptr<Texture> texture = this->layers[layer]->shared_from_this();
+    const unsigned int generation = this->generation;
+
+    if (this->compressedFormat == 0) {
+        const GLenum imageFormat = texture->getImageFormat();
+        const size_t size = texture->getPixelSize(0);
+        TextureUploader::instance()->queue(size,
+            [texture, size] (unsigned char * destination) {
+                return texture->readPixels(0, destination, size);
+            },
+            [this, texture, generation, layer, imageFormat] (const bool filled) {
+                if (!filled || generation != this->generation) return;
+
+                this->bindForUpdate();
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, this->width, this->height, 1,
+                        imageFormat, GL_UNSIGNED_BYTE, nullptr);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                this->mipmapsOutdated = true;
+
+                texture->releasePixels();
+            });
+        return;
+    }
+
+    for (GLint level=this->residentLevel;level<this->levels;level++) {
+        const size_t size = texture->getPixelSize(level);
+        TextureUploader::instance()->queue(size,
+            [texture, level, size] (unsigned char * destination) {
+                return texture->readPixels(level, destination, size);
+            },
+            [this, generation, layer, level] (const bool filled) {
+                if (filled && generation == this->generation) this->uploadLayer(level, layer, nullptr);
+            });
+    }
+}
+
+void TextureArray::allocateLevel(const GLint level) {
+    this->bindForUpdate();
+
+    if (this->compressedFormat == 0) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8,
+                std::max(1, this->width >> level), std::max(1, this->height >> level), this->capacity, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        return;
+    }
+
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, this->compressedFormat,
+            std::max(1, this->width >> level), std::max(1, this->height >> level), this->capacity, 0,
+            this->getLevelSize(level), nullptr);
+}
+
+// with a pixel buffer bound data is the offset into it
+void TextureArray::uploadLayer(const GLint level, const GLint layer, const void * data) {
+    this->bindForUpdate();
+
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+            std::max(1, this->width >> level), std::max(1, this->height >> level), 1,
+            this->compressedFormat, this->getLayerSize(level), data);
+}
+
+// zero sized images free the storage of a level
+void TextureArray::releaseLevel(const GLint level) {
+    this->bindForUpdate();
+
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, this->compressedFormat, 0, 0, 0, 0, 0, nullptr);
+}
+
+void TextureArray::setResidentLevel(const GLint level) {
+    this->bindForUpdate();
+
+    this->residentLevel = level;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, this->residentLevel);
+}
+
+void TextureArray::evictLevel() {
+    if (this->residentLevel >= this->levels - 1) return;
+
+    this->setResidentLevel(this->residentLevel + 1);
+    this->releaseLevel(this->residentLevel - 1);
+}
+
+void TextureArray::generateMipmaps() {
+    if (!this->mipmapsOutdated) return;
+
+    this->bindForUpdate();
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    this->mipmapsOutdated = false;
+}
+
+void TextureArray::request(const GLint level, const unsigned long frame) {
+    if (this->lastUsed != frame) {
+        this->lastUsed = frame;
+        this->requestedLevel = level;
+    } else this->requestedLevel = std::min(this->requestedLevel, level);
+}
+
+std::vector<std::shared_ptr<Texture>> TextureArray::getTextures() {
+    std::vector<std::shared_ptr<Texture>> textures;
+    for (auto * texture : this->layers)
+        if (texture != nullptr) textures.push_back(texture->shared_from_this());
+
+    return textures;
+}
+
+size_t TextureArray::getLayerSize(const GLint level) {
+    const size_t levelWidth = std::max(1, this->width >> level);
+    const size_t levelHeight = std::max(1, this->height >> level);
+
+    if (this->compressedFormat == 0) return levelWidth * levelHeight * 4;
+
+    return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * TextureEncoder::getBlockSize(this->compressedFormat);
+}
+
+size_t TextureArray::getLevelSize(const GLint level) {
+    return this->getLayerSize(level) * this->capacity;
+}
+
+size_t TextureArray::getResidentSize() {
+    size_t size = 0;
+    for (GLint level=this->residentLevel;level<this->levels;level++) size += this->getLevelSize(level);
+
+    return size;
+}
+
+GLuint TextureArray::getId() {
+    if (this->dirty) this->upload();
+
+    return this->id;
+}
+
+void TextureArray::cleanUp() {
+    if (this->id != 0) glDeleteTextures(1, &this->id);
+    this->id = 0;
+}
+
+void TextureArrays::add(std::shared_ptr<Texture> texture) {
+    if (texture == nullptr || !texture->isValid() || texture->getArray() != nullptr) return;
+
+    const GLsizei width = texture->getWidth();
+    const GLsizei height = texture->getHeight();
+
+    // uncompressed arrays get their full mip chain generated on upload
+    GLint levels = texture->getLevels().size();
+    if (!texture->isCompressed()) {
+        levels = 1;
+        while ((std::max(width, height) >> levels) > 0) levels++;
+    }
+
+    const std::string key = std::to_string(width) + "x" + std::to_string(height) + ":" +
+        std::to_string(texture->getCompressedFormat()) + ":" + std::to_string(levels) + ":" + std::to_string(texture->isStreamable());
+
+    TextureArray * array = this->ARRAYS[key];
+    if (array == nullptr) {
+        array = new TextureArray(width, height, texture->getCompressedFormat(), levels, texture->isStreamable());
+        this->ARRAYS[key] = array;
+    }
+
+    texture->setArrayLayer(array, array->addLayer(texture.get()));
+}
+
+void TextureArrays::bind(const GLint unit, TextureArray * array) {
+    if (array == nullptr || unit < 0 || unit >= MaterialPalette::TEXTURE_UNIT) return;
+
+    const GLuint id = array->getId();
+    if (this->boundArrays[unit] == id) return;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    this->boundArrays[unit] = id;
+}
+
+void TextureArrays::bindForUpdate(const GLenum target, const GLuint id) {
+    glActiveTexture(GL_TEXTURE0 + TextureArrays::UPDATE_UNIT);
+    glBindTexture(target, id);
+    if (target == GL_TEXTURE_2D_ARRAY) this->boundArrays[TextureArrays::UPDATE_UNIT] = id;
+}
+
+std::vector<TextureArray *> TextureArrays::getArrays() {
+    std::vector<TextureArray *> arrays;
+    for (auto & arrayEntry : this->ARRAYS) arrays.push_back(arrayEntry.second);
+
+    return arrays;
+}
+
+void TextureArrays::generateMipmaps() {
+    for (auto & arrayEntry : this->ARRAYS) arrayEntry.second->generateMipmaps();
+}
+
+void TextureArrays::invalidate() {
+    for (auto & arrayEntry : this->ARRAYS) arrayEntry.second->invalidate();
+    for (auto & boundArray : this->boundArrays) boundArray = 0;
+}
+
+TextureArrays::~TextureArrays() {
+    for (auto & arrayEntry : this->ARRAYS) {
+        arrayEntry.second->detachLayers();
+        arrayEntry.second->cleanUp();
+        delete arrayEntry.second;
+    }
+    this->ARRAYS.clear();
+
+    TextureArrays::singleton = nullptr;
+}
+
+TextureArrays * TextureArrays::singleton = nullptr;
+
+std::shared_ptr<Texture> TextureRegistry::getTexture(const std::string & path, const std::string & type) {
+    const std::string key = path + "|" + type;
+
+    std::shared_ptr<Texture> texture = this->TEXTURES[key].lock();
+    if (texture != nullptr) return texture;
+
+    for (auto it = this->TEXTURES.begin(); it != this->TEXTURES.end();) {
+        if (it->second.expired()) it = this->TEXTURES.erase(it);
+        else it++;
+    }
+
+    texture.reset(new Texture());
+    texture->setType(type);
+    texture->setPath(path);
+    texture->load();
+    if (!texture->isValid()) return nullptr;
+
+    this->TEXTURES[key] = texture;
+
+    return texture;
+}
+
+TextureRegistry::~TextureRegistry() {
+    this->TEXTURES.clear();
+
+    TextureRegistry::singleton = nullptr;
+}
+
+TextureRegistry * TextureRegistry::singleton = nullptr;
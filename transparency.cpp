@@ -0,0 +1,140 @@
+#include "render.hpp"
+
+TransparencyBuffer::TransparencyBuffer(Shader * shader) {
+    this->shader = shader;
+}
+
+bool TransparencyBuffer::create(const GLsizei width, const GLsizei height) {
+    this->cleanUp();
+
+    // half floats, the weights reach into the thousands
+    const GLint internalFormats[2] = { GL_RGBA16F, GL_R16F };
+    const GLenum formats[2] = { GL_RGBA, GL_RED };
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+
+    glGenTextures(2, this->textures);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    for (int i=0;i<2;i++) {
+        glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], GL_TEXTURE_2D, this->textures[i], 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDrawBuffers(2, drawBuffers);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Transparency buffer is incomplete: " << status << std::endl;
+        this->cleanUp();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+
+    return true;
+}
+
+/*
+ * Copies the opaque depth, then binds and clears the targets for the translucent geometry.
+ * GL 3.3 has one blend state for all targets: colors add up everywhere while alpha, which only
+ * the accumulation target has, is multiplied by the transmittance of every surface
+ */
+bool TransparencyBuffer::begin() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] <= 0 || viewport[3] <= 0) return false;
+
+    // create() leaves framebuffer 0 bound, the scene framebuffer has to be bound again for the depth copy
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &this->previousFramebuffer);
+
+    const GLsizei width = viewport[0] + viewport[2], height = viewport[1] + viewport[3];
+    if (width > this->width || height > this->height) {
+        const bool created = this->create(std::max(width, this->width), std::max(height, this->height));
+        glBindFramebuffer(GL_FRAMEBUFFER, this->previousFramebuffer);
+        if (!created) return false;
+    }
+
+    if (!this->depth.copy()) return false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    // the copy may have been reallocated for a larger viewport
+    this->depth.attach();
+
+    const GLfloat accumulation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const GLfloat weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accumulation);
+    glClearBufferfv(GL_COLOR, 1, weights);
+
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    return true;
+}
+
+/*
+ * Blends the average translucent color over the scene with a screen filling triangle,
+ * pixels no translucent surface covered keep the scene as it is
+ */
+void TransparencyBuffer::end() {
+    glDepthMask(GL_TRUE);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->previousFramebuffer);
+
+    if (this->shader == nullptr) {
+        glDisable(GL_BLEND);
+        return;
+    }
+
+    this->shader->use();
+    if (!this->shader->isBeingUsed()) {
+        glDisable(GL_BLEND);
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + TransparencyBuffer::TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, this->textures[0]);
+    glActiveTexture(GL_TEXTURE0 + TransparencyBuffer::TEXTURE_UNIT + 1);
+    glBindTexture(GL_TEXTURE_2D, this->textures[1]);
+    glActiveTexture(GL_TEXTURE0);
+    this->shader->setInt("accumulation", TransparencyBuffer::TEXTURE_UNIT);
+    this->shader->setInt("weights", TransparencyBuffer::TEXTURE_UNIT + 1);
+
+    if (this->vertexArray == 0) glGenVertexArrays(1, &this->vertexArray);
+
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(this->vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    this->shader->stopUse();
+}
+
+void TransparencyBuffer::cleanUp() {
+    if (this->framebuffer != 0) glDeleteFramebuffers(1, &this->framebuffer);
+    if (this->textures[0] != 0) glDeleteTextures(2, this->textures);
+
+    this->framebuffer = 0;
+    for (auto & texture : this->textures) texture = 0;
+    this->width = 0;
+    this->height = 0;
+}
+
+TransparencyBuffer::~TransparencyBuffer() {
+    this->cleanUp();
+    this->depth.cleanUp();
+
+    if (this->vertexArray != 0) glDeleteVertexArrays(1, &this->vertexArray);
+}
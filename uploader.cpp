@@ -0,0 +1,177 @@
+#include "render.hpp"
+
+// rows are copied without the surface pitch padding, uploads use an unpack alignment of 1
+bool TextureUploader::copySurface(SDL_Surface * surface, unsigned char * destination) {
+    if (surface == nullptr || destination == nullptr) return false;
+
+    const size_t rowSize = static_cast<size_t>(surface->w) * surface->format->BytesPerPixel;
+    const unsigned char * pixels = static_cast<const unsigned char *>(surface->pixels);
+    for (int y=0;y<surface->h;y++) memcpy(destination + y * rowSize, pixels + y * surface->pitch, rowSize);
+
+    return true;
+}
+
+void TextureUploader::queue(const size_t size, std::function<bool(unsigned char *)> fill, std::function<void(const bool)> submit) {
+    if (size == 0 || !fill || !submit) return;
+
+    TextureUpload * upload = new TextureUpload();
+    upload->size = size;
+    upload->fill = fill;
+    upload->submit = submit;
+
+    this->queuedUploads.push_back(upload);
+}
+
+void TextureUploader::map(TextureUpload * upload) {
+    if (this->freeBuffers.empty()) {
+        glGenBuffers(1, &upload->buffer);
+    } else {
+        upload->buffer = this->freeBuffers.back();
+        this->freeBuffers.pop_back();
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload->buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, upload->size, nullptr, GL_STREAM_DRAW);
+    upload->destination = static_cast<unsigned char *>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, upload->size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    this->mappedSize += upload->size;
+}
+
+void TextureUploader::unmap(TextureUpload * upload) {
+    if (upload->destination != nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload->buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        upload->destination = nullptr;
+    }
+
+    if (upload->buffer != 0) this->freeBuffers.push_back(upload->buffer);
+    upload->buffer = 0;
+
+    this->mappedSize -= upload->size;
+}
+
+void TextureUploader::work() {
+    while (true) {
+        TextureUpload * upload = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(this->uploadsMutex);
+            this->uploadsAvailable.wait(lock, [this] { return !this->running || !this->mappedUploads.empty(); });
+            if (!this->running) return;
+
+            upload = this->mappedUploads.front();
+            this->mappedUploads.pop_front();
+        }
+
+        upload->filled = upload->destination != nullptr && upload->fill(upload->destination);
+
+        std::lock_guard<std::mutex> lock(this->uploadsMutex);
+        this->filledUploads.push_back(upload);
+    }
+}
+
+/*
+ * Called once per frame on the GL thread: submits filled pixel buffers in order up to the budget,
+ * at least one per frame, then maps buffers for queued uploads until MAPPED_FRAMES budgets are in flight
+ */
+void TextureUploader::update() {
+    std::deque<TextureUpload *> filled;
+    {
+        std::lock_guard<std::mutex> lock(this->uploadsMutex);
+        filled.swap(this->filledUploads);
+    }
+
+    size_t submittedSize = 0;
+    while (!filled.empty() && (submittedSize == 0 || submittedSize + filled.front()->size <= this->budget)) {
+        TextureUpload * upload = filled.front();
+        filled.pop_front();
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload->buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        upload->destination = nullptr;
+
+        upload->submit(upload->filled);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        submittedSize += upload->size;
+        this->unmap(upload);
+        delete upload;
+    }
+
+    std::vector<TextureUpload *> mapped;
+    while (!this->queuedUploads.empty() &&
+            (this->mappedSize == 0 || this->mappedSize + this->queuedUploads.front()->size <= this->budget * TextureUploader::MAPPED_FRAMES)) {
+        TextureUpload * upload = this->queuedUploads.front();
+        this->queuedUploads.pop_front();
+
+        this->map(upload);
+        if (upload->destination == nullptr) std::cerr << "Failed to map pixel buffer of " << upload->size << " bytes" << std::endl;
+        mapped.push_back(upload);
+    }
+
+    std::lock_guard<std::mutex> lock(this->uploadsMutex);
+
+    // what did not fit the budget goes first next frame
+    this->filledUploads.insert(this->filledUploads.begin(), filled.begin(), filled.end());
+
+    if (mapped.empty()) return;
+
+    // workers are only started once there is something to upload
+    if (this->workers.empty())
+        for (unsigned int i=0;i<TextureUploader::NUMBER_OF_WORKERS;i++) this->workers.push_back(std::thread(&TextureUploader::work, this));
+
+    this->mappedUploads.insert(this->mappedUploads.end(), mapped.begin(), mapped.end());
+    this->uploadsAvailable.notify_all();
+}
+
+/*
+ * Submits without a budget until no upload is queued or in flight, the mapped size only drops
+ * once an upload has been submitted
+ */
+void TextureUploader::flush() {
+    const size_t budget = this->budget;
+    this->budget = std::numeric_limits<size_t>::max() / TextureUploader::MAPPED_FRAMES;
+
+    this->update();
+    while (!this->queuedUploads.empty() || this->mappedSize > 0) {
+        std::this_thread::yield();
+        this->update();
+    }
+
+    this->budget = budget;
+}
+
+TextureUploader::~TextureUploader() {
+    {
+        std::lock_guard<std::mutex> lock(this->uploadsMutex);
+        this->running = false;
+    }
+    this->uploadsAvailable.notify_all();
+
+    for (auto & worker : this->workers) worker.join();
+    this->workers.clear();
+
+    for (auto * upload : this->queuedUploads) delete upload;
+    for (auto * upload : this->mappedUploads) {
+        this->unmap(upload);
+        delete upload;
+    }
+    for (auto * upload : this->filledUploads) {
+        this->unmap(upload);
+        delete upload;
+    }
+    this->queuedUploads.clear();
+    this->mappedUploads.clear();
+    this->filledUploads.clear();
+
+    if (!this->freeBuffers.empty()) glDeleteBuffers(this->freeBuffers.size(), this->freeBuffers.data());
+    this->freeBuffers.clear();
+
+    TextureUploader::singleton = nullptr;
+}
+
+constexpr size_t TextureUploader::DEFAULT_BUDGET;
+
+TextureUploader * TextureUploader::singleton = nullptr;
@@ -0,0 +1,427 @@
+#include "render.hpp"
+
+Vegetation::Vegetation(const Terrain * terrain, Shader * shader) {
+    this->terrain = terrain;
+    this->shader = shader;
+}
+
+/*
+ * Leaves are tapered quads in two segments around the center, leaning outwards by lean at the tip.
+ * Normals point up, which lights the double sided leaves the same from both sides
+ */
+Mesh Vegetation::createClump(const int leaves, const float width, const float height, const float lean) {
+    Mesh mesh;
+
+    for (int i=0;i<leaves;i++) {
+        const float angle = glm::two_pi<float>() * (i + 0.5f * (i % 2)) / leaves;
+        const glm::vec3 outwards = glm::vec3(glm::cos(angle), 0.0f, glm::sin(angle));
+        const glm::vec3 side = glm::vec3(-outwards.z, 0.0f, outwards.x) * (width * 0.5f);
+        const unsigned int first = mesh.vertices.size();
+
+        auto addVertex = [&mesh] (const glm::vec3 & position, const glm::vec2 & uv) {
+            Vertex vertex(position);
+            vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+            vertex.bitangent = glm::vec3(0.0f, 0.0f, 1.0f);
+            vertex.uv = uv;
+            mesh.vertices.push_back(vertex);
+        };
+
+        // the leaf curves outwards, more towards the tip
+        for (int j=0;j<2;j++) {
+            const float t = j * 0.5f;
+            const glm::vec3 center = outwards * (lean * t * t) + glm::vec3(0.0f, height * t, 0.0f);
+            addVertex(center - side * (1.0f - t), glm::vec2(0.0f, t));
+            addVertex(center + side * (1.0f - t), glm::vec2(1.0f, t));
+        }
+        addVertex(outwards * lean + glm::vec3(0.0f, height, 0.0f), glm::vec2(0.5f, 1.0f));
+
+        // left and right at the base and the middle, then the tip
+        const unsigned int triangles[9] = { 0, 1, 2, 1, 3, 2, 2, 3, 4 };
+        for (auto index : triangles) mesh.indices.push_back(first + index);
+    }
+
+    return mesh;
+}
+
+void Vegetation::init() {
+    if (this->initialized || this->terrain == nullptr) return;
+
+    Material grassMaterial;
+    grassMaterial.diffuseColor = glm::vec4(0.35f, 0.6f, 0.2f, 1.0f);
+    grassMaterial.specularColor = glm::vec4(0.05f, 0.05f, 0.05f, 1.0f);
+
+    VegetationKind grass;
+    grass.mesh = Vegetation::createClump(3, 0.06f, 0.5f, 0.15f);
+    grass.minDistance = 0.3f;
+    grass.minUpness = 0.7f;
+    grass.height = 0.5f;
+    grass.materialIndex = MaterialPalette::instance()->addMaterial(grassMaterial);
+    this->kinds.push_back(std::move(grass));
+
+    Material foliageMaterial;
+    foliageMaterial.diffuseColor = glm::vec4(0.2f, 0.4f, 0.12f, 1.0f);
+    foliageMaterial.specularColor = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+
+    VegetationKind foliage;
+    foliage.mesh = Vegetation::createClump(10, 0.35f, 0.9f, 0.6f);
+    foliage.minDistance = 3.0f;
+    foliage.minUpness = 0.85f;
+    foliage.maxHeight = 1.5f;
+    foliage.minScale = 0.6f;
+    foliage.maxScale = 1.4f;
+    foliage.height = 0.9f;
+    foliage.materialIndex = MaterialPalette::instance()->addMaterial(foliageMaterial);
+    this->kinds.push_back(std::move(foliage));
+
+    for (auto & kind : this->kinds) kind.mesh.init();
+
+    this->initialized = true;
+}
+
+/*
+ * Hashes the bits of the position the way the vertex shader does, so that both agree on the order
+ * in which instances drop out
+ */
+float Vegetation::getRank(const glm::vec3 & position) {
+    auto hash = [] (uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+    };
+
+    uint32_t x = 0, z = 0;
+    memcpy(&x, &position.x, sizeof(x));
+    memcpy(&z, &position.z, sizeof(z));
+
+    return static_cast<float>(hash(x ^ hash(z))) / 4294967295.0f;
+}
+
+float Vegetation::getDensity(const float distance) {
+    return 1.0f - glm::clamp((distance - Vegetation::FADE_START) / (Vegetation::FADE_END - Vegetation::FADE_START), 0.0f, 1.0f);
+}
+
+float Vegetation::getDistance(const glm::vec3 & min, const glm::vec3 & max, const glm::vec3 & point) {
+    return glm::length(glm::max(glm::max(min - point, point - max), glm::vec3(0.0f)));
+}
+
+/*
+ * Poisson disk samples in the rectangle (Bridson 2007): new samples are tried in the ring between
+ * radius and twice the radius around active ones, a background grid of radius / sqrt(2) sized cells
+ * holds at most one sample each and makes the distance test local
+ */
+std::vector<glm::vec2> Vegetation::sampleDisk(const glm::vec2 & min, const glm::vec2 & max, const float radius, std::mt19937 & random) {
+    const int ATTEMPTS = 30;
+    const float gridSize = radius / glm::sqrt(2.0f);
+    const int width = static_cast<int>(glm::ceil((max.x - min.x) / gridSize));
+    const int height = static_cast<int>(glm::ceil((max.y - min.y) / gridSize));
+
+    std::vector<glm::vec2> samples;
+    if (width <= 0 || height <= 0) return samples;
+
+    std::vector<int> grid(width * height, -1);
+    std::vector<size_t> active;
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    auto add = [&] (const glm::vec2 & sample) {
+        const int x = std::min(static_cast<int>((sample.x - min.x) / gridSize), width - 1);
+        const int y = std::min(static_cast<int>((sample.y - min.y) / gridSize), height - 1);
+        grid[y * width + x] = samples.size();
+        active.push_back(samples.size());
+        samples.push_back(sample);
+    };
+
+    add(min + (max - min) * glm::vec2(unit(random), unit(random)));
+
+    while (!active.empty()) {
+        const size_t slot = std::uniform_int_distribution<size_t>(0, active.size() - 1)(random);
+        const glm::vec2 center = samples[active[slot]];
+
+        bool added = false;
+        for (int i=0;i<ATTEMPTS && !added;i++) {
+            const float angle = glm::two_pi<float>() * unit(random);
+            const glm::vec2 candidate = center + glm::vec2(glm::cos(angle), glm::sin(angle)) * radius * (1.0f + unit(random));
+            if (candidate.x < min.x || candidate.y < min.y || candidate.x >= max.x || candidate.y >= max.y) continue;
+
+            const int x = std::min(static_cast<int>((candidate.x - min.x) / gridSize), width - 1);
+            const int y = std::min(static_cast<int>((candidate.y - min.y) / gridSize), height - 1);
+
+            bool free = true;
+            for (int gy=std::max(y - 2, 0);gy<=std::min(y + 2, height - 1) && free;gy++) {
+                for (int gx=std::max(x - 2, 0);gx<=std::min(x + 2, width - 1) && free;gx++) {
+                    const int other = grid[gy * width + gx];
+                    if (other >= 0 && glm::distance(samples[other], candidate) < radius) free = false;
+                }
+            }
+
+            if (free) {
+                add(candidate);
+                added = true;
+            }
+        }
+
+        if (!added) {
+            active[slot] = active.back();
+            active.pop_back();
+        }
+    }
+
+    return samples;
+}
+
+/*
+ * Runs on a worker thread, only reads the terrain heights and the parameters of the kinds.
+ * The random sequence is seeded by the cell, a cell that comes back looks the same as before
+ */
+VegetationCell * Vegetation::generate(const std::pair<int, int> & coordinates) {
+    VegetationCell * cell = new VegetationCell();
+    cell->coordinates = coordinates;
+    cell->instances.resize(this->kinds.size());
+    cell->ranks.resize(this->kinds.size());
+
+    const glm::vec2 terrainMin = this->terrain->getMin();
+    const glm::vec2 terrainMax = this->terrain->getMax();
+    const glm::vec2 min = glm::max(glm::vec2(coordinates.first, coordinates.second) * Vegetation::CELL_SIZE, terrainMin);
+    const glm::vec2 max = glm::min(glm::vec2(coordinates.first + 1, coordinates.second + 1) * Vegetation::CELL_SIZE, terrainMax);
+
+    std::mt19937 random(static_cast<uint32_t>(coordinates.first) * 73856093U ^ static_cast<uint32_t>(coordinates.second) * 19349663U);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    float bottom = std::numeric_limits<float>::max(), top = -std::numeric_limits<float>::max();
+    for (size_t k=0;k<this->kinds.size();k++) {
+        const VegetationKind & kind = this->kinds[k];
+
+        std::vector<std::pair<float, InstanceTransform>> ranked;
+        for (auto & sample : Vegetation::sampleDisk(min, max, kind.minDistance, random)) {
+            const float height = this->terrain->getHeight(sample.x, sample.y);
+            const float upness = this->terrain->getNormal(sample.x, sample.y).y;
+
+            // thins out towards the steepest slope and the height limits instead of ending at a hard line
+            const float slopeFactor = glm::smoothstep(kind.minUpness, kind.minUpness + 0.1f, upness);
+            const float heightFactor = glm::smoothstep(kind.minHeight - 0.5f, kind.minHeight, height) *
+                (1.0f - glm::smoothstep(kind.maxHeight, kind.maxHeight + 0.5f, height));
+            if (unit(random) >= slopeFactor * heightFactor) continue;
+
+            const glm::vec3 position = glm::vec3(sample.x, height, sample.y);
+            const glm::quat rotation = glm::angleAxis(glm::two_pi<float>() * unit(random), glm::vec3(0, 1, 0));
+            const float scale = glm::mix(kind.minScale, kind.maxScale, unit(random));
+            ranked.push_back(std::make_pair(Vegetation::getRank(position), InstanceTransform(position, rotation, scale)));
+
+            bottom = std::min(bottom, height);
+            top = std::max(top, height + kind.height * scale);
+        }
+
+        std::sort(ranked.begin(), ranked.end(),
+            [] (const std::pair<float, InstanceTransform> & a, const std::pair<float, InstanceTransform> & b) { return a.first < b.first; });
+
+        for (auto & instance : ranked) {
+            cell->ranks[k].push_back(instance.first);
+            cell->instances[k].push_back(instance.second);
+        }
+    }
+
+    // an empty cell keeps an inverted box and is never drawn
+    cell->min = glm::vec3(min.x, bottom, min.y);
+    cell->max = glm::vec3(max.x, top, max.y);
+
+    return cell;
+}
+
+void Vegetation::work() {
+    while (true) {
+        std::pair<int, int> coordinates;
+        {
+            std::unique_lock<std::mutex> lock(this->cellsMutex);
+            this->cellsQueued.wait(lock, [this] { return !this->running || !this->queuedCells.empty(); });
+            if (!this->running) return;
+
+            coordinates = this->queuedCells.front();
+            this->queuedCells.pop_front();
+        }
+
+        VegetationCell * cell = this->generate(coordinates);
+
+        std::lock_guard<std::mutex> lock(this->cellsMutex);
+        this->generatedCells.push_back(cell);
+    }
+}
+
+/*
+ * Takes over what the workers generated, drops cells a cell size beyond the stream distance
+ * and queues the missing ones within it, closest first. The queue is rebuilt every frame
+ * so that a moving camera does not wait for cells it has already left behind
+ */
+void Vegetation::stream(const glm::vec3 & eye) {
+    const float dropDistance = Vegetation::STREAM_DISTANCE + Vegetation::CELL_SIZE;
+    auto getCellDistance = [eye] (const std::pair<int, int> & coordinates) {
+        const glm::vec2 min = glm::vec2(coordinates.first, coordinates.second) * Vegetation::CELL_SIZE;
+        return glm::length(glm::max(glm::max(min - glm::vec2(eye.x, eye.z), glm::vec2(eye.x, eye.z) - min - Vegetation::CELL_SIZE), glm::vec2(0.0f)));
+    };
+
+    std::deque<VegetationCell *> generated;
+    {
+        std::lock_guard<std::mutex> lock(this->cellsMutex);
+        generated.swap(this->generatedCells);
+        for (auto & coordinates : this->queuedCells) this->pendingCells.erase(coordinates);
+        this->queuedCells.clear();
+    }
+
+    for (auto * cell : generated) {
+        this->pendingCells.erase(cell->coordinates);
+        if (getCellDistance(cell->coordinates) > dropDistance) delete cell;
+        else this->cells[cell->coordinates] = cell;
+    }
+
+    for (auto it = this->cells.begin(); it != this->cells.end();) {
+        if (getCellDistance(it->first) <= dropDistance) {
+            it++;
+            continue;
+        }
+
+        delete it->second;
+        it = this->cells.erase(it);
+    }
+
+    const glm::vec2 terrainMin = this->terrain->getMin();
+    const glm::vec2 terrainMax = this->terrain->getMax();
+    const glm::ivec2 first = glm::ivec2(glm::floor(glm::max(glm::vec2(eye.x, eye.z) - Vegetation::STREAM_DISTANCE, terrainMin) / Vegetation::CELL_SIZE));
+    const glm::ivec2 last = glm::ivec2(glm::ceil(glm::min(glm::vec2(eye.x, eye.z) + Vegetation::STREAM_DISTANCE, terrainMax) / Vegetation::CELL_SIZE));
+
+    std::vector<std::pair<float, std::pair<int, int>>> missing;
+    for (int x=first.x;x<last.x;x++) {
+        for (int z=first.y;z<last.y;z++) {
+            const std::pair<int, int> coordinates = std::make_pair(x, z);
+            if (this->cells.find(coordinates) != this->cells.end() || this->pendingCells.count(coordinates) > 0) continue;
+
+            const float distance = getCellDistance(coordinates);
+            if (distance <= Vegetation::STREAM_DISTANCE) missing.push_back(std::make_pair(distance, coordinates));
+        }
+    }
+
+    if (missing.empty()) return;
+    std::sort(missing.begin(), missing.end());
+
+    std::lock_guard<std::mutex> lock(this->cellsMutex);
+    for (auto & cell : missing) {
+        this->queuedCells.push_back(cell.second);
+        this->pendingCells.insert(cell.second);
+    }
+
+    // workers are only started once there is something to generate
+    if (this->workers.empty())
+        for (unsigned int i=0;i<Vegetation::NUMBER_OF_WORKERS;i++) this->workers.push_back(std::thread(&Vegetation::work, this));
+
+    this->cellsQueued.notify_all();
+}
+
+/*
+ * Cells in the frustum contribute the prefix of their instances that is dense enough at their closest point,
+ * the vertex shader thins out the rest per instance
+ */
+void Vegetation::updateInstances(const glm::vec3 & eye) {
+    std::vector<VegetationCell *> visible;
+    std::vector<size_t> drawn;
+    for (auto & cellEntry : this->cells) {
+        VegetationCell * cell = cellEntry.second;
+        if (cell->min.y > cell->max.y || !Camera::instance()->isInFrustum(cell->min, cell->max)) continue;
+
+        const float density = Vegetation::getDensity(Vegetation::getDistance(cell->min, cell->max, eye));
+        if (density <= 0.0f) continue;
+
+        visible.push_back(cell);
+        drawn.push_back(reinterpret_cast<uintptr_t>(cell));
+        for (auto & ranks : cell->ranks)
+            drawn.push_back(std::upper_bound(ranks.begin(), ranks.end(), density) - ranks.begin());
+    }
+
+    if (drawn == this->drawn) return;
+    this->drawn = drawn;
+
+    const size_t numberOfKinds = this->kinds.size();
+    for (size_t k=0;k<numberOfKinds;k++) {
+        VegetationKind & kind = this->kinds[k];
+        kind.instanceTransforms.clear();
+
+        for (size_t i=0;i<visible.size();i++) {
+            const std::vector<InstanceTransform> & instances = visible[i]->instances[k];
+            const size_t count = drawn[i * (numberOfKinds + 1) + 1 + k];
+            kind.instanceTransforms.insert(kind.instanceTransforms.end(), instances.begin(), instances.begin() + count);
+        }
+
+        std::vector<GLushort> materialIndices(kind.instanceTransforms.size(), kind.materialIndex);
+        kind.mesh.setMaterialIndices(materialIndices);
+        kind.mesh.setInstanceTransforms(kind.instanceTransforms);
+    }
+}
+
+/*
+ * Drawn with the culling off, leaves are seen from both sides. Vegetation casts no shadows
+ * and stays out of the depth pre-pass, the wind would have to be repeated there
+ */
+void Vegetation::render() {
+    if (!this->initialized || this->shader == nullptr) return;
+
+    const glm::vec3 eye = Camera::instance()->getPosition();
+    this->stream(eye);
+    this->updateInstances(eye);
+
+    const GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+
+    for (auto & kind : this->kinds) {
+        if (kind.instanceTransforms.empty()) continue;
+
+        Shader * variant = kind.mesh.selectShader(this->shader);
+        variant->use();
+        if (!variant->isBeingUsed()) continue;
+
+        variant->setSceneUniforms();
+        variant->setFloat("time", static_cast<float>(SDL_GetTicks()) / 1000.0f);
+        variant->setVec3("wind", this->wind);
+        variant->setVec2("vegetationFade", glm::vec2(Vegetation::FADE_START, Vegetation::FADE_END));
+
+        kind.mesh.render(variant);
+
+        variant->stopUse();
+    }
+
+    if (cullFace == GL_TRUE) glEnable(GL_CULL_FACE);
+}
+
+void Vegetation::cleanUp() {
+    {
+        std::lock_guard<std::mutex> lock(this->cellsMutex);
+        this->running = false;
+    }
+    this->cellsQueued.notify_all();
+
+    for (auto & worker : this->workers) worker.join();
+    this->workers.clear();
+
+    for (auto * cell : this->generatedCells) delete cell;
+    for (auto & cellEntry : this->cells) delete cellEntry.second;
+    this->generatedCells.clear();
+    this->queuedCells.clear();
+    this->pendingCells.clear();
+    this->cells.clear();
+    this->drawn.clear();
+
+    if (!this->initialized) return;
+
+    for (auto & kind : this->kinds) kind.mesh.cleanUp();
+    this->kinds.clear();
+
+    this->initialized = false;
+}
+
+Vegetation::~Vegetation() {
+    this->cleanUp();
+}
+
+constexpr float Vegetation::CELL_SIZE;
+constexpr float Vegetation::STREAM_DISTANCE;
+constexpr float Vegetation::FADE_START;
+constexpr float Vegetation::FADE_END;
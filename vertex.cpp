@@ -0,0 +1,65 @@
+#include "render.hpp"
+
+static glm::vec3 normalizeOr(const glm::vec3 & vector, const glm::vec3 & fallback) {
+    const float length = glm::length(vector);
+    return length > std::numeric_limits<float>::epsilon() ? vector / length : fallback;
+}
+
+static GLuint packNormal(const Vertex & vertex) {
+    return glm::packSnorm3x10_1x2(glm::vec4(normalizeOr(vertex.normal, glm::vec3(0.0f, 1.0f, 0.0f)), 0.0f));
+}
+
+static GLuint packTangent(const Vertex & vertex) {
+    const glm::vec3 normal = normalizeOr(vertex.normal, glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::vec3 tangent = normalizeOr(vertex.tangent, glm::vec3(1.0f, 0.0f, 0.0f));
+
+    // the bitangent is rebuilt in the shader as cross(normal, tangent) * w
+    const float sign = glm::dot(glm::cross(normal, tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    return glm::packSnorm3x10_1x2(glm::vec4(tangent, sign));
+}
+
+template<> std::vector<VertexAttribute> VertexLayout<PackedVertex>::getAttributes() {
+    return {
+        { 0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position) },
+        { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv) },
+        { 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, tangent) }
+    };
+}
+
+template<> PackedVertex VertexLayout<PackedVertex>::encode(const Vertex & vertex, const VertexBounds & bounds) {
+    PackedVertex packed;
+
+    packed.position = vertex.position;
+    packed.normal = packNormal(vertex);
+    packed.tangent = packTangent(vertex);
+    packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+
+    return packed;
+}
+
+template<> std::vector<VertexAttribute> VertexLayout<QuantizedVertex>::getAttributes() {
+    return {
+        { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position) },
+        { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, uv) },
+        { 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, tangent) }
+    };
+}
+
+template<> QuantizedVertex VertexLayout<QuantizedVertex>::encode(const Vertex & vertex, const VertexBounds & bounds) {
+    QuantizedVertex quantized;
+
+    const glm::vec3 relativePosition = (vertex.position - bounds.min) / bounds.extent;
+    for (int i=0;i<3;i++) quantized.position[i] = glm::packUnorm1x16(relativePosition[i]);
+    quantized.position[3] = 0;
+
+    quantized.normal = packNormal(vertex);
+    quantized.tangent = packTangent(vertex);
+    quantized.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    quantized.uv[1] = glm::packHalf1x16(vertex.uv.y);
+
+    return quantized;
+}
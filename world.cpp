@@ -27,6 +27,27 @@ glm::vec3 World::getSunDirection() {
     return this->sunDirection;
 };
 
+void World::addPointLight(const PointLight & light) {
+    this->pointLights.push_back(light);
+}
+
+void World::addSpotLight(const SpotLight & light) {
+    this->spotLights.push_back(light);
+}
+
+std::vector<PointLight> & World::getPointLights() {
+    return this->pointLights;
+}
+
+std::vector<SpotLight> & World::getSpotLights() {
+    return this->spotLights;
+}
+
+void World::clearLights() {
+    this->pointLights.clear();
+    this->spotLights.clear();
+}
+
 void World::toggleGravity() {
     this->gravity = !this->gravity;
 }
@@ -3,6 +3,31 @@
 
     #include "includes.hpp"
 
+    class PointLight {
+        public:
+            glm::vec3 position = glm::vec3(0.0f);
+            glm::vec3 color = glm::vec3(1.0f);
+            // nothing beyond the radius is lit
+            float radius = 10.0f;
+
+            PointLight() {};
+            PointLight(const glm::vec3 & position, const glm::vec3 & color, const float radius) :
+                position(position), color(color), radius(radius) {};
+    };
+
+    class SpotLight : public PointLight {
+        public:
+            glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            // half angles in radians, full intensity inside the inner cone fading out to the outer one
+            float innerAngle = glm::radians(20.0f);
+            float outerAngle = glm::radians(30.0f);
+
+            SpotLight() {};
+            SpotLight(const glm::vec3 & position, const glm::vec3 & direction, const glm::vec3 & color, const float radius,
+                    const float innerAngle, const float outerAngle) :
+                PointLight(position, color, radius), direction(direction), innerAngle(innerAngle), outerAngle(outerAngle) {};
+    };
+
     class World final {
     private:
         static World * singleton;
@@ -17,6 +42,9 @@
         glm::vec3 sunDirection = glm::vec3(20.0f, 100.0f, 15.0f);
         glm::vec3 sunLightColor = DEFAULT_SUNLIGHT_COLOR;
 
+        std::vector<PointLight> pointLights;
+        std::vector<SpotLight> spotLights;
+
         World();
     public:
         void toggleGravity();
@@ -26,6 +54,12 @@
         glm::vec3 getAmbientLight();
         glm::vec3 getSunDirection();
         glm::vec3 getSunLightColor();
+        void addPointLight(const PointLight & light);
+        void addSpotLight(const SpotLight & light);
+        // lights may be moved and recolored in place, they are re-clustered every frame
+        std::vector<PointLight> & getPointLights();
+        std::vector<SpotLight> & getSpotLights();
+        void clearLights();
         static World * instance();
 };
 